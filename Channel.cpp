@@ -0,0 +1,103 @@
+#include "Channel.h"
+#include "Scheduler.h"
+#include <cstring>
+
+Channel::Channel(Scheduler *scheduler, size_t elem_size, int capacity) : scheduler(scheduler),
+        elem_size(elem_size), capacity(capacity), buffer(new char[elem_size * capacity]), head(0), count(0),
+        closed(false), senders{nullptr, nullptr}, receivers{nullptr, nullptr} {}
+
+Channel::~Channel() {
+    delete[] buffer;
+}
+
+char *Channel::slot(int index) const {
+    return buffer + (size_t) (index % capacity) * elem_size;
+}
+
+void Channel::finish(ChanWaiter *waiter, bool ok) {
+    waiter->done = true;
+    waiter->ok = ok;
+    if (waiter->thread == nullptr)
+        waiter->complete(waiter);
+    else
+        scheduler->wakeWaiter(waiter);
+}
+
+Channel::Result Channel::trySend(const void *elem, Thread **woken) {
+    *woken = nullptr;
+    if (closed)
+        return CLOSED;
+
+    auto *receiver = (ChanWaiter *) WaitQueue(&receivers).popFront();
+    if (receiver != nullptr) {
+        // the buffer is empty, or no one would be waiting
+        memcpy(receiver->object, elem, elem_size);
+        // read before finish: the waiter of a task may be freed once it is completed
+        Thread *thread = receiver->thread;
+        finish(receiver, true);
+        *woken = thread;
+        return DONE;
+    }
+    if (count == capacity)
+        return WOULD_BLOCK;
+
+    memcpy(slot(head + count), elem, elem_size);
+    count++;
+    return DONE;
+}
+
+Channel::Result Channel::tryRecv(void *elem) {
+    auto *sender = (ChanWaiter *) WaitQueue(&senders).popFront();
+    if (count > 0) {
+        memcpy(elem, slot(head), elem_size);
+        head = (head + 1) % capacity;
+        count--;
+        if (sender != nullptr) {
+            // the buffer was full: the sender's element takes the freed place, after the others
+            memcpy(slot(head + count), sender->object, elem_size);
+            count++;
+            finish(sender, true);
+        }
+        return DONE;
+    }
+    if (sender != nullptr) {
+        memcpy(elem, sender->object, elem_size);
+        finish(sender, true);
+        return DONE;
+    }
+    if (!closed)
+        return WOULD_BLOCK;
+
+    memset(elem, 0, elem_size);
+    return CLOSED;
+}
+
+void Channel::addSender(ChanWaiter *waiter) {
+    WaitQueue(&senders).pushBack(waiter);
+}
+
+void Channel::addReceiver(ChanWaiter *waiter) {
+    WaitQueue(&receivers).pushBack(waiter);
+}
+
+void Channel::close() {
+    closed = true;
+    while (auto *receiver = (ChanWaiter *) WaitQueue(&receivers).popFront()) {
+        memset(receiver->object, 0, elem_size);
+        finish(receiver, false);
+    }
+    while (auto *sender = (ChanWaiter *) WaitQueue(&senders).popFront())
+        finish(sender, false);
+}
+
+bool Channel::isClosed() const {
+    return closed;
+}
+
+int Channel::getCapacity() const {
+    return capacity;
+}
+
+bool Channel::hasWaiters() const {
+    return senders.head != nullptr || receivers.head != nullptr;
+}
@@ -0,0 +1,99 @@
+#ifndef OS_EX2_CHANNEL_H
+#define OS_EX2_CHANNEL_H
+
+#include <cstddef>
+#include "uthreads.h"
+#include "WaitQueue.h"
+
+class Scheduler;
+
+/*
+ * A thread waiting to send to or receive from a Channel. object is the element: where it is sent from, or
+ * received into.
+ */
+struct ChanWaiter : Waiter {
+    int index; // the uthread_chan_select case the waiter stands for
+    bool done; // the thread that woke us carried out the operation, or closed the channel
+    bool ok; // false if the channel was closed instead
+    void (*complete)(ChanWaiter *waiter); // ends the operation of a waiter no thread waits on (its thread is nullptr)
+
+    ChanWaiter() : Waiter(nullptr), index(0), done(false), ok(false), complete(nullptr) {}
+
+    ChanWaiter(Thread *thread, void *elem, int index = 0) : Waiter(thread, elem), index(index), done(false),
+            ok(false), complete(nullptr) {}
+};
+
+/*
+ * A channel, see uthread_chan_create: a ring buffer of capacity elements (none for an unbuffered channel),
+ * and the FIFOs of the threads waiting to send and to receive.
+ *
+ * An element goes straight from a waiting sender to the receiver, or from the sender to a waiting receiver,
+ * and only goes through the buffer when no one waits on the other side. Only used under the scheduler's lock.
+ */
+class Channel {
+public:
+    enum Result {DONE, WOULD_BLOCK, CLOSED};
+
+    Channel(Scheduler *scheduler, size_t elem_size, int capacity);
+
+    ~Channel();
+
+    /**
+     * sends the element without waiting: to the first waiting receiver, or into the buffer.
+     * @param woken set to the receiver's thread if a receiver was woken, nullptr otherwise
+     * @return DONE, WOULD_BLOCK if the buffer is full and no one waits to receive, or CLOSED
+     */
+    Result trySend(const void *elem, Thread **woken);
+
+    /**
+     * receives an element without waiting: from the buffer (letting the first waiting sender in), or from
+     * the first waiting sender.
+     * @return DONE, WOULD_BLOCK if nothing was sent, or CLOSED if the channel is closed and drained, in which
+     * case elem is zeroed
+     */
+    Result tryRecv(void *elem);
+
+    /**
+     * queues the waiter of a thread that is about to wait to send (or receive) the waiter's element, or of an
+     * operation no thread waits for (see uthread_chan_start)
+     */
+    void addSender(ChanWaiter *waiter);
+    void addReceiver(ChanWaiter *waiter);
+
+    /**
+     * closes the channel, and wakes every waiting thread: receivers receive nothing, and senders fail
+     */
+    void close();
+
+    bool isClosed() const;
+
+    /**
+     * the number of elements the buffer holds, 0 for an unbuffered channel
+     */
+    int getCapacity() const;
+
+    /**
+     * true if threads wait to send or receive
+     */
+    bool hasWaiters() const;
+
+private:
+    Scheduler *scheduler;
+    const size_t elem_size;
+    const int capacity;
+    char *buffer;
+    int head; // the buffer index of the oldest element
+    int count;
+    bool closed;
+    uthread_wait_queue senders;
+    uthread_wait_queue receivers;
+
+    /*
+     * wakes the waiter's thread, which is done with its operation (or completes the operation, if no thread waits)
+     */
+    void finish(ChanWaiter *waiter, bool ok);
+
+    char *slot(int index) const;
+};
+
+#endif //OS_EX2_CHANNEL_H
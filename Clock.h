@@ -0,0 +1,15 @@
+#ifndef OS_EX2_CLOCK_H
+#define OS_EX2_CLOCK_H
+
+#include <time.h>
+
+/*
+ * reads the given clock (CLOCK_MONOTONIC, CLOCK_THREAD_CPUTIME_ID, ...) in nanoseconds
+ */
+inline long long clockNsecs(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+#endif //OS_EX2_CLOCK_H
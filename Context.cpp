@@ -0,0 +1,76 @@
+#include "Context.h"
+#include <cstdint>
+
+/*
+ * uthread_context_switch(save_sp = %rdi, load_sp = %rsi)
+ *
+ * pushes the callee-saved registers and the MXCSR / x87 control words on the current stack,
+ * stores the resulting stack pointer in *save_sp, then pops the same frame off load_sp and
+ * returns into the context that was suspended there.
+ *
+ * uthread_context_start is the return address planted in a fresh frame by Context::init: it calls
+ * entry(arg), both of which were placed in r12 / r13 as if they were saved registers.
+ */
+asm(
+    ".pushsection .text\n"
+    ".globl uthread_context_switch\n"
+    ".type uthread_context_switch, @function\n"
+    "uthread_context_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size uthread_context_switch, .-uthread_context_switch\n"
+    "\n"
+    ".type uthread_context_start, @function\n"
+    "uthread_context_start:\n"
+    "    movq %r13, %rdi\n"
+    "    callq *%r12\n"
+    "    ud2\n"
+    ".size uthread_context_start, .-uthread_context_start\n"
+    ".popsection\n"
+);
+
+extern "C" void uthread_context_start();
+
+namespace {
+    // slot layout of a suspended frame, from the saved stack pointer upwards
+    enum FrameSlot {CONTROL_WORDS, R15, R14, R13, R12, RBX, RBP, RETURN_ADDRESS, FRAME_SLOTS};
+
+    const uint32_t DEFAULT_MXCSR = 0x1F80; // all SSE exceptions masked, round to nearest
+    const uint16_t DEFAULT_FPU_CW = 0x037F; // all x87 exceptions masked, extended precision
+}
+
+Context::Context() : sp(nullptr) {}
+
+void Context::init(char *stack, size_t size, void (*entry)(void *), void *arg) {
+    // the ABI wants rsp 16-byte aligned right before the call in uthread_context_start
+    auto top = ((uintptr_t) stack + size) & ~(uintptr_t) 15;
+    auto *frame = (uint64_t *) (top - FRAME_SLOTS * sizeof(uint64_t));
+
+    for (int slot = 0; slot < FRAME_SLOTS; ++slot)
+        frame[slot] = 0;
+    frame[CONTROL_WORDS] = DEFAULT_MXCSR | ((uint64_t) DEFAULT_FPU_CW << 32);
+    frame[R12] = (uint64_t) entry;
+    frame[R13] = (uint64_t) arg;
+    frame[RETURN_ADDRESS] = (uint64_t) &uthread_context_start;
+
+    sp = frame;
+}
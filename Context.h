@@ -0,0 +1,45 @@
+#ifndef OS_EX2_CONTEXT_H
+#define OS_EX2_CONTEXT_H
+
+#include <cstddef>
+
+#if !defined(__x86_64__)
+#error "uthreads context switching is implemented for x86-64 only"
+#endif
+
+/*
+ * The register state of a suspended thread.
+ *
+ * Only the stack pointer is stored here: the callee-saved registers (rbx, rbp, r12-r15) and the
+ * x87/SSE control words are pushed on the thread's own stack by uthread_context_switch, so a
+ * switch is a handful of pushes, two stack pointer moves and a handful of pops, with no system
+ * calls. The signal mask is NOT part of the context - keeping SIGVTALRM masked across a switch is
+ * the job of the caller (see Scheduler).
+ */
+class Context {
+public:
+    Context();
+
+    /**
+     * prepares the context so that the first switch into it calls entry(arg) on the given stack.
+     * entry must never return.
+     */
+    void init(char *stack, size_t size, void (*entry)(void *), void *arg);
+
+    /**
+     * saves the calling context into this object and resumes next.
+     * returns when some other context switches back into this one.
+     */
+    void switchTo(Context &next);
+
+private:
+    void *sp;
+};
+
+extern "C" void uthread_context_switch(void **save_sp, void *load_sp);
+
+inline void Context::switchTo(Context &next) {
+    uthread_context_switch(&sp, next.sp);
+}
+
+#endif //OS_EX2_CONTEXT_H
@@ -0,0 +1,124 @@
+#include "Poller.h"
+#include "Scheduler.h"
+#include <cerrno>
+#include <iostream>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+Poller::Poller(Scheduler *scheduler) : scheduler(scheduler), waiters(0), polling(false), events() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd;
+    if (epoll_fd < 0 || wake_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) < 0) {
+        std::cerr << "system error: failed to create the epoll instance\n";
+        exit(1);
+    }
+}
+
+Poller::~Poller() {
+    for (PollEntry *entry : entries)
+        delete entry;
+    close(wake_fd);
+    close(epoll_fd);
+}
+
+bool Poller::arm(int fd, PollEntry *entry) {
+    struct epoll_event event = {};
+    event.events = EPOLLONESHOT | EPOLLRDHUP;
+    if (entry->readers.head != nullptr)
+        event.events |= EPOLLIN;
+    if (entry->writers.head != nullptr)
+        event.events |= EPOLLOUT;
+    event.data.fd = fd;
+
+    // an fd that was closed and reopened since it was registered left the epoll instance with the close
+    if (entry->registered && epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0)
+        return true;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0 ||
+            (errno == EEXIST && epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0)) {
+        entry->registered = true;
+        return true;
+    }
+    return false;
+}
+
+bool Poller::addWaiter(int fd, bool write, Waiter *waiter) {
+    if (fd < 0 || fd == epoll_fd || fd == wake_fd) {
+        errno = EBADF;
+        return false;
+    }
+    if ((size_t) fd >= entries.size())
+        entries.resize(fd + 1, nullptr);
+    if (entries[fd] == nullptr)
+        entries[fd] = new PollEntry();
+
+    PollEntry *entry = entries[fd];
+    waiter->object = this;
+    WaitQueue(write ? &entry->writers : &entry->readers).pushBack(waiter);
+    if (!arm(fd, entry)) {
+        int error = errno;
+        WaitQueue::remove(waiter);
+        errno = error;
+        return false;
+    }
+    waiters.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool Poller::removeWaiter(Waiter *waiter) {
+    if (waiter->object != this)
+        return false;
+    if (waiter->queue != nullptr) {
+        WaitQueue::remove(waiter);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool Poller::hasWaiters() const {
+    return waiters.load(std::memory_order_relaxed) > 0;
+}
+
+bool Poller::acquire() {
+    return !polling.load(std::memory_order_relaxed) && !polling.exchange(true, std::memory_order_acquire);
+}
+
+int Poller::wait(int timeout_ms) {
+    int count = epoll_wait(epoll_fd, events, POLL_EVENTS, timeout_ms);
+    return count > 0 ? count : 0;
+}
+
+void Poller::wakeAll(uthread_wait_queue *queue) {
+    WaitQueue waiting(queue);
+    while (Waiter *waiter = waiting.popFront()) {
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        scheduler->wakeWaiter(waiter);
+    }
+}
+
+void Poller::dispatch(int count) {
+    for (int i = 0; i < count; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == wake_fd) {
+            eventfd_t value;
+            eventfd_read(wake_fd, &value);
+            continue;
+        }
+
+        // errors and hang-ups wake both sides, their next call reports it
+        PollEntry *entry = entries[fd];
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+            wakeAll(&entry->readers);
+        if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+            wakeAll(&entry->writers);
+        if (entry->readers.head != nullptr || entry->writers.head != nullptr)
+            arm(fd, entry);
+    }
+    polling.store(false, std::memory_order_release);
+}
+
+void Poller::interrupt() {
+    eventfd_write(wake_fd, 1);
+}
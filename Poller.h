@@ -0,0 +1,102 @@
+#ifndef OS_EX2_POLLER_H
+#define OS_EX2_POLLER_H
+
+#include <atomic>
+#include <vector>
+#include <sys/epoll.h>
+#include "uthreads.h"
+#include "WaitQueue.h"
+
+#define POLL_EVENTS 64 /* ready events taken from the epoll instance at once */
+
+class Scheduler;
+
+/*
+ * The threads waiting for a file descriptor to become readable or writable.
+ */
+struct PollEntry {
+    uthread_wait_queue readers;
+    uthread_wait_queue writers;
+    bool registered; // the fd was added to the epoll instance (it leaves it by itself when it is closed)
+
+    PollEntry() : readers{nullptr, nullptr}, writers{nullptr, nullptr}, registered(false) {}
+};
+
+/*
+ * The epoll instance behind uthread_read and friends. A thread whose fd is not ready waits in the fd's
+ * PollEntry, and the fd is armed in the epoll instance (one-shot) for the directions threads wait in; the
+ * scheduler polls it to wake them.
+ *
+ * Only one kernel thread polls at a time (acquire), into the Poller's own event buffer, and the events are
+ * dispatched under the scheduler's lock. wait can be called without the lock, so an idle worker can block in it.
+ */
+class Poller {
+public:
+    explicit Poller(Scheduler *scheduler);
+
+    ~Poller();
+
+    /**
+     * queues the waiter for the fd to become readable (or writable), and arms the fd. the waiter's object is set to
+     * the Poller, which tells removeWaiter it is one of its own.
+     * @return false if the fd cannot be polled (errno is set), in which case the waiter is not queued
+     */
+    bool addWaiter(int fd, bool write, Waiter *waiter);
+
+    /**
+     * takes the waiter out of its fd's queue, if addWaiter queued it, for a thread terminated while waiting. the fd
+     * stays armed until it becomes ready, and then wakes no one.
+     * @return false if the waiter is not one of the Poller's
+     */
+    bool removeWaiter(Waiter *waiter);
+
+    /**
+     * true if threads are waiting for an fd. needs no lock.
+     */
+    bool hasWaiters() const;
+
+    /**
+     * takes the event buffer, unless another kernel thread is polling. needs no lock.
+     * @return true if the caller is now the one polling, and must follow with wait and dispatch
+     */
+    bool acquire();
+
+    /**
+     * takes the ready events into the buffer, waiting for them for up to timeout_ms milliseconds (0 to only look),
+     * or until interrupt is called. needs no lock.
+     * @return the number of events taken
+     */
+    int wait(int timeout_ms);
+
+    /**
+     * wakes the threads waiting for the fds of the events taken by wait, rearms the fds other threads still wait
+     * for, and gives the event buffer back. called under the scheduler's lock.
+     */
+    void dispatch(int count);
+
+    /**
+     * makes a wait that is blocked in another kernel thread return
+     */
+    void interrupt();
+
+private:
+    Scheduler *scheduler;
+    int epoll_fd;
+    int wake_fd; // an eventfd in the epoll instance, for interrupt
+    std::vector<PollEntry *> entries; // by fd, allocated the first time a thread waits for the fd
+    std::atomic<int> waiters;
+    std::atomic<bool> polling;
+    struct epoll_event events[POLL_EVENTS];
+
+    /*
+     * arms the fd for the directions threads wait in. returns false if epoll refused it.
+     */
+    bool arm(int fd, PollEntry *entry);
+
+    /*
+     * wakes every thread in the queue
+     */
+    void wakeAll(uthread_wait_queue *queue);
+};
+
+#endif //OS_EX2_POLLER_H
@@ -0,0 +1,163 @@
+#ifndef OS_EX2_RUNQUEUE_H
+#define OS_EX2_RUNQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+
+class Thread;
+
+#define RUN_QUEUE_SLOTS 256 /* the slots a run queue starts with, it doubles whenever it fills up */
+
+/*
+ * The FIFO of READY threads of one worker and priority level.
+ *
+ * A ring of thread pointers between a head and a tail index: only the worker that owns the queue pushes, at the tail,
+ * with a plain store, and the owner and the other workers all take from the head, with a compare-and-swap of it. A
+ * worker that runs dry moves half of another worker's queue into its own with a single compare-and-swap (see
+ * stealInto), so nothing here takes a lock. The owner takes with a compare-and-swap too, rather than popping its own
+ * end like a work-stealing deque: threads are run in the order they became ready, which round robin needs.
+ *
+ * A full ring is replaced by one twice its size. Another worker may still be reading the old ring, so the old rings
+ * are only deleted with the queue.
+ *
+ * An entry may be stale: a thread that was blocked or terminated while in a queue is left in it, and whoever takes
+ * it drops it (see Thread::takeFromQueue). A thread is in at most one queue at a time.
+ */
+class RunQueue {
+public:
+    RunQueue();
+    ~RunQueue();
+
+    /**
+     * the number of entries, stale ones included. any kernel thread may call it, the result may be out of date by the
+     * time it returns.
+     */
+    int size() const;
+    bool empty() const;
+
+    /**
+     * adds the thread at the tail. only the owner may call it.
+     */
+    void push(Thread *thread);
+
+    /**
+     * removes and returns the thread at the head, nullptr if the queue is empty. any kernel thread may call it.
+     */
+    Thread *pop();
+
+    /**
+     * moves the older half of the entries (rounded up) to the tail of the given queue, in order. only the owner of
+     * the given queue may call it.
+     * @return the number of entries moved
+     */
+    int stealInto(RunQueue *thief);
+
+private:
+    struct Ring {
+        std::atomic<Thread*> *slots;
+        uint32_t mask;
+        Ring *older; // the ring this one replaced
+    };
+
+    std::atomic<uint32_t> head; // the index of the oldest entry, entries are at index % ring size
+    std::atomic<uint32_t> tail; // one past the newest entry, only stored by the owner
+    std::atomic<Ring*> ring;
+
+    /**
+     * makes room for count more entries past the tail, replacing the ring if it is too small. only the owner may call
+     * it.
+     */
+    Ring *reserve(uint32_t count);
+};
+
+inline RunQueue::RunQueue() : head(0), tail(0), ring(new Ring{new std::atomic<Thread*>[RUN_QUEUE_SLOTS](),
+                                                              RUN_QUEUE_SLOTS - 1, nullptr}) {}
+
+inline RunQueue::~RunQueue() {
+    for (Ring *old = ring.load(); old != nullptr;) {
+        Ring *older = old->older;
+        delete[] old->slots;
+        delete old;
+        old = older;
+    }
+}
+
+inline int RunQueue::size() const {
+    auto count = (int32_t) (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_relaxed));
+    return count > 0 ? count : 0;
+}
+
+inline bool RunQueue::empty() const {
+    return size() == 0;
+}
+
+inline RunQueue::Ring *RunQueue::reserve(uint32_t count) {
+    Ring *current = ring.load(std::memory_order_relaxed);
+    uint32_t first = head.load(std::memory_order_acquire);
+    uint32_t end = tail.load(std::memory_order_relaxed);
+    if (end - first + count <= current->mask + 1)
+        return current;
+
+    uint32_t slots = (current->mask + 1) * 2;
+    while (end - first + count > slots)
+        slots *= 2;
+    Ring *bigger = new Ring{new std::atomic<Thread*>[slots](), slots - 1, current};
+    // entries taken meanwhile are copied too, harmlessly: the head is already past them
+    for (uint32_t i = first; i != end; ++i)
+        bigger->slots[i & bigger->mask].store(current->slots[i & current->mask].load(std::memory_order_relaxed),
+                                              std::memory_order_relaxed);
+    ring.store(bigger, std::memory_order_release);
+    return bigger;
+}
+
+inline void RunQueue::push(Thread *thread) {
+    Ring *current = reserve(1);
+    uint32_t end = tail.load(std::memory_order_relaxed);
+    current->slots[end & current->mask].store(thread, std::memory_order_relaxed);
+    tail.store(end + 1, std::memory_order_release);
+}
+
+inline Thread *RunQueue::pop() {
+    uint32_t first = head.load(std::memory_order_acquire);
+    for (;;) {
+        // the tail is read before the ring, so the ring is at least the one the entries below the tail were put in
+        uint32_t end = tail.load(std::memory_order_acquire);
+        if ((int32_t) (end - first) <= 0)
+            return nullptr;
+        Ring *current = ring.load(std::memory_order_acquire);
+        Thread *thread = current->slots[first & current->mask].load(std::memory_order_relaxed);
+        // the release orders the read of the slot before the owner may reuse it
+        if (head.compare_exchange_weak(first, first + 1, std::memory_order_release, std::memory_order_acquire))
+            return thread;
+    }
+}
+
+inline int RunQueue::stealInto(RunQueue *thief) {
+    uint32_t first = head.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t end = tail.load(std::memory_order_acquire);
+        auto count = (int32_t) (end - first);
+        if (count <= 0)
+            return 0;
+        count -= count / 2;
+        Ring *current = ring.load(std::memory_order_acquire);
+        if ((uint32_t) count > current->mask + 1) { // the head moved on since it was read
+            first = head.load(std::memory_order_acquire);
+            continue;
+        }
+
+        // copied past the thief's tail, where no one takes from until the tail is moved
+        Ring *target = thief->reserve(count);
+        uint32_t target_end = thief->tail.load(std::memory_order_relaxed);
+        for (int32_t i = 0; i < count; ++i)
+            target->slots[(target_end + i) & target->mask].store(
+                    current->slots[(first + i) & current->mask].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+        if (head.compare_exchange_weak(first, first + count, std::memory_order_release, std::memory_order_acquire)) {
+            thief->tail.store(target_end + count, std::memory_order_release);
+            return count;
+        }
+    }
+}
+
+#endif //OS_EX2_RUNQUEUE_H
@@ -1,225 +1,870 @@
 #include <iostream>
+#include <climits>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include "Scheduler.h"
 
-Scheduler::Scheduler(int quantum_length, struct sigaction sa) : quant_len(quantum_length), sa(sa){
+SpinLock Scheduler::state_lock;
+bool Scheduler::multicore = false;
+
+Scheduler::Scheduler(int quantum_length, int max_threads, int worker_count, int levels, int boost_period,
+                     bool collect_stats, bool tickless, int manual_ticks, int trace_events,
+                     struct sigaction sa) :
+        worker_count(worker_count), quant_len(quantum_length), levels(levels), boost_period(boost_period),
+        boosts(0), next_boost(boost_period), sa(sa), collect_stats(collect_stats), tickless(tickless),
+        tracing(trace_events > 0), manual_ticks(manual_ticks), ticks_left(0), work_epoch(0),
+        idle_workers(0), poller(new Poller(this)), poll_blocked(false), inbox(new WakeInbox(max_threads)){
+    multicore = worker_count > 1;
+    if (collect_stats)
+        Thread::enableStats();
+
     //initialize data bases
-    ready = new std::list<Thread*>();
-    blocked = new std::map<int,Thread*>();
-    sleeping = new std::map<int,int>();
-    threads = new std::map<int,Thread*>();
-    next_sleep_check = 0;
+    threads = new ThreadTable(max_threads);
+    sleeping = new TimerHeap(max_threads);
+    timers = new TimerHeap(max_threads);
+    workers = new Worker*[worker_count];
+    for (int i = 0; i < worker_count; ++i) {
+        workers[i] = new Worker(i, this, levels);
+        if (tracing)
+            workers[i]->setTrace(new TraceRing(trace_events));
+    }
+
+    // worker 0 is the calling kernel thread, whose stack belongs to the main thread, so its idle thread
+    // needs a stack of its own. the other workers idle on their kernel thread's stack.
+    workers[0]->setIdleThread(new Thread(Scheduler::idleEntry, workers[0]));
+    if (!workers[0]->getIdleThread()->hasStack()) {
+        std::cerr << "system error: failed to allocate a thread stack\n";
+        exit(1);
+    }
+    for (int i = 1; i < worker_count; ++i)
+        workers[i]->setIdleThread(new Thread(nullptr, workers[i]));
 
     // configure the timer_data to expire every 0 sec after that. (meaning the timer_data will go off only once)
-    timer_data = {0, 0, 0, quant_len};
+    // the time until it goes off is set by runTimer, according to the level of the thread it starts.
+    timer_data = {{0, 0}, {0, 0}};
 
     //add the main thread to the Scheduler's database and run it manually.
+    Thread::reserveIDs(max_threads);
     auto *main = new Thread(nullptr);
-    main->setState(RUNNING);
-    threads->insert({0,main});
-    running = main;
+    main->claim(); // it is running already
+    main->setWorker(workers[0]);
+    threads->insert(main);
+    workers[0]->attach(main);
+    if (multicore && !workers[0]->useThreadTimer()) {
+        std::cerr << "system error: failed to create a worker timer\n";
+        exit(1);
+    }
     total_quantum_counter = 0;
-    runTimer();
+    runTimer(workers[0]);
 }
 
 Scheduler::~Scheduler() {
-    Thread *main;
-    for (auto iter : *threads) {
-        if (iter.first == 0)
-            main = iter.second;
-        else
-            delete iter.second;
+    // the threads that left the table while they had a stale entry in a ready line, the others are in the table
+    for (int i = 0; i < worker_count; ++i) {
+        while (Thread *thread = workers[i]->popReady()) {
+            if (thread->takeFromQueue() == STEP_DELETE)
+                delete thread;
+        }
     }
+    // the main thread goes last
+    for (int id = threads->end() - 1; id >= 0; --id)
+        delete threads->get(id);
 
-    delete main;
+    for (int i = 0; i < worker_count; ++i)
+        delete workers[i];
+    delete[] workers;
     delete threads;
-    delete ready;
-    delete blocked;
     delete sleeping;
-    delete terminated;
+    delete timers;
+    delete poller;
+    delete inbox;
+}
+
+void Scheduler::startWorkers() {
+    for (int i = 1; i < worker_count; ++i) {
+        if (!workers[i]->start()) {
+            std::cerr << "system error: failed to start a worker kernel thread\n";
+            exit(1);
+        }
+    }
 }
 
 Thread* Scheduler::getThreadByID(int id) const{
-    auto iter = threads->find(id);
-    if (iter == threads->end()) return nullptr;
-    return iter->second;
+    return threads->get(id);
 }
 
 Thread* Scheduler::getCurrentThread() const{
-    return running;
+    return Worker::current()->getRunning();
 }
 
 
 int Scheduler::addNewThread(Thread* thread) {
-    if (threads->size() == MAX_THREAD_NUM) {
+    if (!threads->insert(thread)) {
         return 0; // error
     }
 
-    threads->insert({thread->getId(),thread});
+    // read before the thread is queued: once the scheduler's lock is released it may run, end and be reaped
+    int tid = thread->getId();
     setReady(thread);
 
-    return thread->getId();
+    return tid;
+}
+
+bool Scheduler::canAddThread(int count) const {
+    return threads->size() + count <= threads->getMaxThreads();
+}
+
+bool Scheduler::reserveThreads(int count) {
+    // IDs are handed out lowest first, so the new threads' IDs are all below the number of threads there will be
+    threads->reserve(threads->size() + count);
+    return Thread::reserveStacks(count);
+}
+
+int Scheduler::getMaxThreads() const {
+    return threads->getMaxThreads();
 }
 
-void Scheduler::runThread(Thread *thread) {
-    thread->setState(RUNNING);
-    running = thread;
-    runTimer();
-    thread->restoreState();
+void Scheduler::runThread(Worker *worker, Thread *thread, bool preempted, bool run_next) {
+    Thread *previous = worker->getRunning();
+    thread->setWorker(worker);
+    worker->setRunning(thread);
+    trace(TRACE_RUN, thread, thread->getLevel());
+    // picked again: a preempted thread with no one else to run starts a new quantum, a yield keeps its own
+    if (previous != thread || preempted)
+        runTimer(worker);
+    // a request made before the worker was set, whose interrupt the new quantum may have cleared (see
+    // Thread::setWorker), is carried out by the thread once it leaves its critical section
+    if (thread->getRequest() != NO_REQUEST)
+        Worker::setPreemptionPending(true);
+    if (previous == thread)
+        return;
+    recordSwitch(worker, previous, preempted);
+
+    // the switch happens inside a critical section, and the thread we resume leaves its own
+    previous->saveErrno();
+    thread->restoreErrno();
+    worker->setSwitchedFrom(previous, run_next);
+    previous->switchTo(*thread);
+    // resumed, maybe by another worker
+    finishSwitch(Worker::current());
 }
 
+void Scheduler::switchToIdle(Worker *worker) {
+    Thread *previous = worker->getRunning();
+    Thread *idle = worker->getIdleThread();
+    recordSwitch(worker, previous, false);
+    trace(TRACE_IDLE, nullptr);
+    worker->setRunning(idle);
+    previous->saveErrno();
+    worker->setSwitchedFrom(previous, false);
+    previous->switchTo(*idle);
+    finishSwitch(Worker::current());
+}
+
+void Scheduler::finishSwitch(Worker *worker) {
+    bool run_next;
+    Thread *previous = worker->takeSwitchedFrom(&run_next);
+    if (previous != nullptr && previous != worker->getIdleThread()) {
+        // from here on another worker may run it
+        switch (previous->leaveCpu()) {
+            case STEP_QUEUE:
+                queueReady(worker, previous, run_next);
+                break;
+            case STEP_DELETE:
+                worker->pushTerminated(previous);
+                break;
+            default:
+                break;
+        }
+    }
+    reapTerminated(worker);
+}
 
 void Scheduler::setReady(Thread *thread) {
-    thread->setState(READY);
-    ready->push_back(thread);
+    trace(TRACE_READY, thread);
+    currentLevel(thread);
+    if (thread->makeReady())
+        queueReady(Worker::current(), thread);
+}
+
+void Scheduler::queueReady(Worker *worker, Thread *thread, bool run_next) {
+    if (run_next)
+        worker->pushNext(thread);
+    else
+        worker->pushReady(thread);
+    // in tickless mode the running thread may have been running alone, with no timer to preempt it
+    if (tickless && worker->getTimerMode() != TIMER_PERIODIC && worker->getRunning() != worker->getIdleThread())
+        programTimer(worker);
+    notifyWork();
 }
 
 void Scheduler::blockThread(Thread *thread) {
-    // for threads sent here from sleep function, we dont want to change their state.
-    // but when a block is added to an already sleeping (blocked) function, then we DO want to set state to BLOCKED.
-    if (thread->getState() != SLEEPING || blocked->count(thread->getId()) != 0)
-        thread->setState(BLOCKED);
-    blocked->insert({thread->getId(),thread});
-    if (running == thread){
-        sigset_t  temp = {0};
-        sigprocmask(SIG_UNBLOCK, &temp, nullptr);
-        int status = running->saveRunStatus();
-        if (!running->saveRunStatus()) {
-            sigprocmask(SIG_BLOCK, &temp, nullptr);
-            runNextThread();
+    trace(TRACE_BLOCK, thread);
+    Worker *worker = Worker::current();
+    if (worker->getRunning() == thread){
+        if (thread->getRequest() == TERMINATE_REQUESTED) {
+            terminateThread(thread);
             return;
         }
+        thread->setRequest(NO_REQUEST);
+        thread->setState(BLOCKED);
+        runNextThreadLocked(worker);
+        return;
     }
-    else {
-        ready->remove(thread);
+
+    // a sleeping thread that gets blocked keeps its wake up time, and stays BLOCKED after waking up.
+    // a READY thread keeps its entry in the ready line, which is dropped when it is taken, unless a worker
+    // claims it first
+    for (;;) {
+        State state = thread->getState();
+        if (state == RUNNING) {
+            // running on another worker: that worker blocks it the next time it reschedules
+            if (thread->getRequest() != TERMINATE_REQUESTED)
+                thread->setRequest(BLOCK_REQUESTED);
+            thread->getWorker()->interrupt();
+            return;
+        }
+        if (thread->changeState(state, BLOCKED))
+            return;
     }
 }
 
 void Scheduler::unblockThread(Thread* thread) {
+    trace(TRACE_UNBLOCK, thread);
+    if (thread->getRequest() == BLOCK_REQUESTED) {
+        thread->setRequest(NO_REQUEST);
+        if (thread->getState() == RUNNING || thread->getState() == READY) // the block never took effect
+            return;
+    }
+
     if (thread->getState() != BLOCKED) // dont unblock thread that is meant to be sleeping
         return;
-    else if (sleeping->count(thread->getId())) {
+    else if (thread->isSleeping()) {
         thread->setState(SLEEPING);
         return;
     }
+    else if (thread->getWaiter() != nullptr) {
+        thread->setState(WAITING);
+        return;
+    }
 
-    blocked->erase(thread->getId());
     setReady(thread);
 }
 
+void Scheduler::postResume(int tid) {
+    if (!inbox->post(tid, threads->getGeneration(tid)))
+        return; // whoever posted it first wakes a worker
+
+    // like notifyWork: a worker that goes idle after the epoch was bumped sees the post before it waits
+    work_epoch.fetch_add(1);
+    if (idle_workers.load() > 0)
+        syscall(SYS_futex, (int *) &work_epoch, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    else if (tickless)
+        workers[0]->interrupt(); // its running thread may have no timer to preempt it
+    if (poll_blocked.load())
+        poller->interrupt();
+}
+
 void Scheduler::sleepCurrentThread(int num_quants) {
-    int wake_up_time = total_quantum_counter + num_quants;
-    if (next_sleep_check == 0 || wake_up_time < next_sleep_check)
-        next_sleep_check = wake_up_time;
-    sleeping->insert({running->getId(),wake_up_time});
+    Worker *worker = Worker::current();
+    Thread *running = worker->getRunning();
+    if (running->getRequest() == TERMINATE_REQUESTED) {
+        terminateThread(running);
+        return;
+    }
+    trace(TRACE_SLEEP, running);
+    TimerNode *timer = running->getSleepTimer();
+    timer->deadline = total_quantum_counter + num_quants;
+    sleeping->push(timer);
     running->setState(SLEEPING);
-    blockThread(running);
+    runNextThreadLocked(worker);
 }
 
-void Scheduler::terminateThread(Thread *thread) {
-    if (thread->getId() == running->getId()){
-        //mask signals from timer_data until we restart it
-        sigaddset(&sa.sa_mask, SIGVTALRM);
-        if (terminated != nullptr && terminated != running) {
-            removeThread(terminated);
-            delete terminated;
+void Scheduler::sleepCurrentThreadUntil(long long deadline) {
+    Worker *worker = Worker::current();
+    Thread *running = worker->getRunning();
+    if (running->getRequest() == TERMINATE_REQUESTED) {
+        terminateThread(running);
+        return;
+    }
+    trace(TRACE_SLEEP, running);
+    TimerNode *timer = running->getWakeTimer();
+    timer->deadline = deadline;
+    timers->push(timer);
+    running->setState(SLEEPING);
+    runNextThreadLocked(worker);
+}
+
+void Scheduler::waitCurrentThread(Waiter *waiter, Thread *hand_to, long long deadline) {
+    Worker *worker = Worker::current();
+    Thread *running = worker->getRunning();
+    running->setWaiter(waiter);
+    if (running->getRequest() == TERMINATE_REQUESTED) {
+        terminateThread(running);
+        return;
+    }
+    trace(TRACE_WAIT, running);
+    if (deadline > 0) {
+        running->getWakeTimer()->deadline = deadline;
+        timers->push(running->getWakeTimer());
+    }
+    if (running->getRequest() == BLOCK_REQUESTED) {
+        running->setRequest(NO_REQUEST);
+        running->setState(BLOCKED);
+    }
+    else
+        running->setState(WAITING);
+
+    if (hand_to != nullptr && hand_to->getRequest() == NO_REQUEST && hand_to->claim()) {
+        // switch straight to the thread we just woke, it has the mutex the caller released. its entry in the
+        // ready line is left stale.
+        chargeRunning(worker);
+        unlock();
+        runThread(worker, hand_to);
+        lock();
+        return;
+    }
+    runNextThreadLocked(worker);
+}
+
+void Scheduler::cancelTimeout(Thread *thread) {
+    timers->remove(thread->getWakeTimer());
+}
+
+void Scheduler::wakeWaiter(Waiter *waiter) {
+    Thread *thread = waiter->thread;
+    WaitQueue::removeAll(waiter);
+    timers->remove(thread->getWakeTimer());
+    thread->setWaiter(nullptr);
+    if (thread->getState() == WAITING)
+        setReady(thread);
+}
+
+void Scheduler::yieldCurrentThread() {
+    Worker *worker = Worker::current();
+    // no one to hand over to (threads at lower MLFQ levels do not count): keep running, and keep the timer as it is
+    if (!worker->hasReadyUpTo(currentLevel(worker->getRunning())))
+        return;
+
+    setReady(worker->getRunning());
+    runNextThread(worker);
+}
+
+bool Scheduler::waitForFd(int fd, bool write, Waiter *waiter) {
+    if (!poller->addWaiter(fd, write, waiter))
+        return false;
+    waitCurrentThread(waiter);
+    return true;
+}
+
+void Scheduler::switchToThread(Thread *thread) {
+    Worker *worker = Worker::current();
+    if (thread->getRequest() != NO_REQUEST || !thread->claim())
+        return;
+
+    Thread *running = worker->getRunning();
+    chargeRunning(worker);
+    currentLevel(running);
+    running->makeReady(); // queued once the worker is off it
+    unlock();
+    runThread(worker, thread, false, true);
+    lock();
+}
+
+void Scheduler::terminateThread(Thread *thread, SpecificValue **specific) {
+    trace(TRACE_TERMINATE, thread);
+    Worker *worker = Worker::current();
+    if (thread == worker->getRunning()){
+        // we are still running on its stack, the worker deletes it once it switched away. a zombie is deleted by
+        // its joiner, or by the worker if the joiner gets to it first (see Thread::release)
+        thread->setState(TERMINATED);
+        if (endThread(thread))
+            thread->release();
+        unlock();
+        runNextThread(worker);
+        return; // not reached, no worker runs a TERMINATED thread
+    }
+
+    // stop it before another worker claims it: a READY thread's entry in the ready line is left stale
+    for (;;) {
+        State state = thread->getState();
+        if (state == RUNNING) {
+            // running on another worker: that worker terminates it the next time it reschedules
+            thread->setRequest(TERMINATE_REQUESTED);
+            thread->getWorker()->interrupt();
+            return;
         }
+        if (thread->changeState(state, TERMINATED))
+            break;
+    }
+    if (specific != nullptr)
+        *specific = thread->takeSpecific();
+    if (endThread(thread) && thread->release())
+        delete thread;
+}
 
-        terminated = running;
-        terminated->setState(TERMINATED);
-        removeThread(thread);
-        thread->removeID();
-        runNextThread();
+bool Scheduler::endThread(Thread *thread) {
+    unlinkThread(thread);
+    Waiter *joiner = WaitQueue(thread->getJoiners()).popFront();
+    if (joiner != nullptr) {
+        wakeWaiter(joiner);
+        return false;
     }
-    else {
-        removeThread(thread);
+    if (thread->isJoinable())
+        return false;
+    threads->remove(thread);
+    thread->removeID();
+    return true;
+}
+
+void Scheduler::reapThread(Thread *thread) {
+    threads->remove(thread);
+    thread->removeID();
+    if (thread->release())
         delete thread;
+}
+
+void Scheduler::runNextThread(Worker *worker, bool preempted) {
+    chargeRunning(worker);
+    Thread *next_in_line = pickNextThread(worker);
+    if (next_in_line == nullptr && worker->getRunning()->reclaim())
+        next_in_line = worker->getRunning();
+    if (next_in_line != nullptr)
+        runThread(worker, next_in_line, preempted);
+    else
+        switchToIdle(worker);
+}
+
+void Scheduler::runNextThreadLocked(Worker *worker) {
+    unlock();
+    runNextThread(worker);
+    lock();
+}
+
+Thread *Scheduler::pickNextThread(Worker *worker) {
+    for (;;) {
+        handleDue();
+        // an epoll_wait costs about as much as a switch, so busy workers only poll every few switches
+        if (poller->hasWaiters() && worker->countUnpolled() >= POLL_INTERVAL_SWITCHES)
+            pollIO(worker);
+        Thread *thread = takeReady(worker);
+        if (thread == nullptr && multicore && stealThreads(worker))
+            thread = takeReady(worker);
+        if (thread == nullptr && poller->hasWaiters()) {
+            pollIO(worker);
+            thread = takeReady(worker);
+        }
+        if (thread == nullptr)
+            return nullptr;
+        if (thread->getRequest() == NO_REQUEST)
+            return thread;
+
+        // requests are only made of RUNNING threads, and ours is one now
+        lock();
+        switch (thread->getRequest()) {
+            case TERMINATE_REQUESTED:
+                thread->setState(TERMINATED);
+                if (endThread(thread))
+                    thread->release();
+                break;
+            case BLOCK_REQUESTED:
+                thread->setRequest(NO_REQUEST);
+                thread->setState(BLOCKED);
+                break;
+            default: // unblocked meanwhile, the block never took effect
+                unlock();
+                return thread;
+        }
+        unlock();
+        // we claimed it, so we are the one to let go of it
+        if (thread->leaveCpu() == STEP_DELETE)
+            worker->pushTerminated(thread);
     }
 }
 
-void Scheduler::runNextThread() {
-    Thread *next_in_line = ready->front();
-    ready->pop_front();
-    runThread(next_in_line);
+Thread *Scheduler::takeReady(Worker *worker) {
+    worker->boostReady(boosts.load(std::memory_order_relaxed));
+    while (Thread *thread = worker->popReady()) {
+        switch (thread->takeFromQueue()) {
+            case STEP_RUN:
+                return thread;
+            case STEP_DELETE:
+                worker->pushTerminated(thread);
+                break;
+            default:
+                break;
+        }
+    }
+    return nullptr;
 }
 
-void Scheduler::runTimer() {
-    running->incrementQuantumAmount();
-    total_quantum_counter++;
+bool Scheduler::stealThreads(Worker *worker) {
+    Worker *victim = nullptr;
+    int victim_count = 0;
+    for (int i = 0; i < worker_count; ++i) {
+        int count = workers[i] != worker ? workers[i]->readyCount() : 0;
+        if (count > victim_count) {
+            victim = workers[i];
+            victim_count = count;
+        }
+    }
+    return victim != nullptr && worker->stealFrom(victim);
+}
+
+void Scheduler::reapTerminated(Worker *worker) {
+    if (!worker->hasTerminated())
+        return;
+    lock();
+    for (Thread *thread = worker->takeTerminated(); thread != nullptr;) {
+        Thread *next = thread->getNextTerminated();
+        delete thread;
+        thread = next;
+    }
+    unlock();
+}
+
+void Scheduler::notifyWork() {
+    if (!multicore)
+        return;
+
+    // a worker that goes idle counts itself before it looks for work one last time, so either it sees the thread
+    // that was just pushed, or we see it and bump the epoch it is about to wait on
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_workers.load() == 0)
+        return;
+    work_epoch.fetch_add(1);
+    syscall(SYS_futex, (int *) &work_epoch, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    if (poll_blocked.load())
+        poller->interrupt();
+}
+
+void Scheduler::handleDue() {
+    bool posted = inbox->hasPosts();
+    bool expired = timers->earliest() != LLONG_MAX && timers->earliest() <= clockNsecs(CLOCK_MONOTONIC);
+    if (!posted && !expired)
+        return;
+    lock();
+    if (posted)
+        handleInbox();
+    if (expired)
+        handleTimers();
+    unlock();
+}
+
+void Scheduler::pollIO(Worker *worker) {
+    worker->clearUnpolled();
+    if (poller->hasWaiters() && poller->acquire()) {
+        int events = poller->wait(0);
+        lock();
+        poller->dispatch(events);
+        unlock();
+    }
+}
+
+bool Scheduler::isWorkAvailable() const {
+    for (int i = 0; i < worker_count; ++i) {
+        if (workers[i]->readyCount() > 0)
+            return true;
+    }
+    return inbox->hasPosts();
+}
+
+void Scheduler::idleEntry(void *worker) {
+    auto *self = (Worker *) worker;
+    self->getScheduler()->finishSwitch(self);
+    self->getScheduler()->idleLoop(self);
+}
+
+void Scheduler::idleLoop(Worker *worker) {
+    for (;;) {
+        reapTerminated(worker);
+        Thread *next_in_line = pickNextThread(worker);
+        if (next_in_line != nullptr) {
+            // back here once the worker runs out of threads again
+            runThread(worker, next_in_line);
+            continue;
+        }
+
+        worker->disarmTimer();
+        long long wait_nsecs = idleWaitNsecs();
+        unsigned epoch = work_epoch.load();
+        idle_workers++;
+
+        int events = -1;
+        if (!isWorkAvailable()) {
+            if (poller->hasWaiters() && poller->acquire()) {
+                // wait for the fds instead, notifyWork interrupts the wait once it bumped the epoch
+                poll_blocked.store(true);
+                int wait_msecs = (int) ((wait_nsecs + 999999) / 1000000);
+                events = work_epoch.load() == epoch ? poller->wait(wait_msecs) : 0;
+                poll_blocked.store(false);
+            }
+            else {
+                struct timespec timeout = {0, wait_nsecs};
+                syscall(SYS_futex, (int *) &work_epoch, FUTEX_WAIT_PRIVATE, epoch, &timeout, nullptr, 0);
+            }
+        }
+
+        idle_workers--;
+        if (events >= 0) {
+            lock();
+            poller->dispatch(events);
+            unlock();
+        }
+    }
+}
+
+void Scheduler::runTimer(Worker *worker) {
+    worker->getRunning()->incrementQuantumAmount();
+    int quantum = ++total_quantum_counter;
+    // a new quantum supersedes a preemption that was pending for the previous one
+    Worker::setPreemptionPending(false);
 
     //we reached this function only if the thread ran a full quantum
-    if (total_quantum_counter == next_sleep_check) {
+    if (sleeping->earliest() <= quantum) {
+        lock();
         Scheduler::handleSleeping();
+        unlock();
+    }
+
+    // the worker that moves the next boost on does the boost
+    int boost_quantum = next_boost.load();
+    if (boost_period > 0 && quantum >= boost_quantum &&
+            next_boost.compare_exchange_strong(boost_quantum, quantum + boost_period))
+        boostThreads();
+
+    if (manual_ticks > 0) {
+        // lower levels get longer quantums, in ticks
+        ticks_left = manual_ticks << currentLevel(worker->getRunning());
+        return;
+    }
+
+    if (tickless) {
+        // the periodic timer keeps running across switches, the new generation restarts the quantum count
+        worker->countSwitch();
+        programTimer(worker);
+        return;
     }
 
-    if (setitimer(ITIMER_VIRTUAL, &timer_data, nullptr)) {
+    // lower levels get longer quantums
+    long long usecs = (long long) quant_len << currentLevel(worker->getRunning());
+    timer_data.it_value.tv_sec = usecs / 1000000;
+    timer_data.it_value.tv_usec = usecs % 1000000;
+
+    if (!worker->armTimer(timer_data)) {
         std::cerr << "system error: failed to start timer_data\n";
-        delete this;
+        if (!multicore)
+            delete this;
         exit(1);
     }
 }
 
-void Scheduler::timerHandler(int sig) {
-    sigset_t  temp = {0};
-    sigaddset(&temp, SIGVTALRM);
-    sigprocmask(SIG_BLOCK, &temp, nullptr);
-    if (terminated != nullptr) {
-        delete terminated;
-        terminated = nullptr;
+void Scheduler::programTimer(Worker *worker) {
+    bool armed;
+    if (worker->readyCount() > 0 || sleeping->earliest() != LLONG_MAX || poller->hasWaiters()) {
+        armed = worker->startTicking(quant_len);
+    }
+    else if (timers->earliest() != LLONG_MAX) {
+        long long usecs = (timers->earliest() - clockNsecs(CLOCK_MONOTONIC)) / 1000;
+        armed = worker->armOnce(usecs < 1 ? 1 : usecs);
+    }
+    else {
+        worker->disarmTimer();
+        armed = true;
     }
 
-    setReady(running);
+    if (!armed) {
+        std::cerr << "system error: failed to start timer_data\n";
+        if (!multicore)
+            delete this;
+        exit(1);
+    }
+}
 
-    sigprocmask(SIG_UNBLOCK, &temp, nullptr);
+void Scheduler::timerHandler(int) {
+    Worker *worker = Worker::current();
+    reapTerminated(worker);
+
+    Thread *running = worker->getRunning();
+    trace(TRACE_TICK, running, running->getLevel());
+    if (running->getRequest() != NO_REQUEST) {
+        lock();
+        switch (running->getRequest()) {
+            case TERMINATE_REQUESTED:
+                terminateThread(running);
+                break;
+            case BLOCK_REQUESTED:
+                running->setRequest(NO_REQUEST);
+                blockThread(running);
+                break;
+            default: // unblocked meanwhile, the block never took effect
+                break;
+        }
+        unlock();
+        return;
+    }
 
-    if (!running->saveRunStatus()) {
-        sigprocmask(SIG_BLOCK, &temp, nullptr);
-        runNextThread();
+    int level = currentLevel(running);
+    if (tickless && (worker->getTimerMode() != TIMER_PERIODIC || worker->countTick() < (1 << level))) {
+        // a tick within the quantum, or the deadline the timer was set for: the threads it readied run
+        // once the quantum is over, so the timer goes on ticking. the tick was the pending preemption, if
+        // it arrived in a critical section
+        Worker::setPreemptionPending(false);
+        handleDue();
+        pollIO(worker);
+        programTimer(worker);
         return;
     }
+    if (level < levels - 1)
+        running->setLevel(level + 1, boosts);
+    // once a quantum, the threads whose deadline passed or whose fds became ready get in line before it
+    handleDue();
+    pollIO(worker);
+    setReady(running);
+    runNextThread(worker, true);
 }
 
-void Scheduler::handleSleeping() {
-    int next_check = 0;
-    auto iter = sleeping->begin();
-    while (iter != sleeping->end()) {
-        if (iter->second == next_sleep_check) {
-            int id = iter->first;
-            iter = sleeping->erase(iter);
-            Thread *thread = blocked->at(id);
-            if (thread->getState() == SLEEPING) {
-                thread->setState(BLOCKED);
-                unblockThread(thread);
-            }
-        }
-        else {
-            if (next_check == 0 || iter->second < next_check)
-                next_check = iter->second;
-            ++iter;
+void Scheduler::tick() {
+    if (--ticks_left > 0)
+        return;
+    timerHandler(SIGVTALRM);
+}
+
+bool Scheduler::isManualTick() const {
+    return manual_ticks > 0;
+}
+
+int Scheduler::currentLevel(Thread *thread) {
+    int boost = boosts.load();
+    if (thread->getLevelBoost() != boost)
+        thread->setLevel(0, boost);
+    return thread->getLevel();
+}
+
+void Scheduler::boostThreads() {
+    boosts++;
+}
+
+void Scheduler::handleTimers() {
+    long long now = clockNsecs(CLOCK_MONOTONIC);
+    while (!timers->empty() && timers->top()->deadline <= now) {
+        Thread *thread = timers->pop()->thread;
+        Waiter *waiter = thread->getWaiter();
+        if (waiter == nullptr) {
+            if (thread->getState() == SLEEPING)
+                setReady(thread);
+            continue;
         }
+
+        waiter->timed_out = true;
+        if (waiter->expire != nullptr)
+            waiter->expire(waiter);
+        else
+            wakeWaiter(waiter);
+    }
+}
+
+void Scheduler::handleInbox() {
+    for (int tid = inbox->take(); tid != INBOX_END;) {
+        unsigned generation;
+        int next = inbox->release(tid, &generation);
+        Thread *thread = threads->get(tid, generation);
+        if (thread != nullptr && thread->getState() != TERMINATED)
+            unblockThread(thread);
+        tid = next;
+    }
+}
+
+long long Scheduler::idleWaitNsecs() {
+    long long wait_nsecs = IDLE_WAIT_USECS * 1000LL;
+    if (timers->earliest() != LLONG_MAX) {
+        long long until_deadline = timers->earliest() - clockNsecs(CLOCK_MONOTONIC);
+        wait_nsecs = until_deadline < 0 ? 0 : until_deadline < wait_nsecs ? until_deadline : wait_nsecs;
     }
+    return wait_nsecs;
+}
 
-    next_sleep_check = next_check;
+void Scheduler::handleSleeping() {
+    while (!sleeping->empty() && sleeping->top()->deadline <= total_quantum_counter) {
+        Thread *thread = sleeping->pop()->thread;
+        if (thread->getState() == SLEEPING)
+            setReady(thread);
+    }
 }
 
 int Scheduler::getTotalQuantumCycles() const {
     return total_quantum_counter;
 }
 
-/*
- * remove an existing thread from the Scheduler's databases
- */
-void Scheduler::removeThread(Thread *thread) {
-    if (thread == nullptr)
+void Scheduler::chargeRunning(Worker *worker) {
+    if (!collect_stats)
+        return;
+
+    long long now = clockNsecs(CLOCK_THREAD_CPUTIME_ID);
+    worker->getRunning()->addCpuTime(now - worker->getCpuMark());
+    worker->setCpuMark(now);
+}
+
+void Scheduler::recordSwitch(Worker *worker, Thread *previous, bool preempted) {
+    if (!collect_stats)
+        return;
+
+    // for a switch out of the idle thread, this is the CPU time of the idle loop
+    long long now = clockNsecs(CLOCK_THREAD_CPUTIME_ID);
+    worker->addSchedulerTime(now - worker->getCpuMark());
+    worker->setCpuMark(now);
+    if (previous == worker->getIdleThread())
         return;
 
-    int id = thread->getId();
-    ready->remove(thread);
-    blocked->erase(id);
-    sleeping->erase(id);
-    threads->erase(id);
+    previous->countSwitch(preempted);
+    worker->countThreadSwitch(preempted);
+}
+
+bool Scheduler::isCollectingStats() const {
+    return collect_stats;
 }
 
+void Scheduler::getStats(Thread *thread, uthread_stats *out) const {
+    thread->getStats(out);
+    Worker *worker = Worker::current();
+    if (thread == worker->getRunning())
+        out->cpu_nsecs += clockNsecs(CLOCK_THREAD_CPUTIME_ID) - worker->getCpuMark();
+}
+
+void Scheduler::getGlobalStats(uthread_global_stats *out) const {
+    *out = {};
+    for (int i = 0; i < worker_count; ++i)
+        workers[i]->addStats(out);
+    out->threads = threads->size();
+}
 
+bool Scheduler::isTracing() const {
+    return tracing;
+}
+
+int Scheduler::getWorkerCount() const {
+    return worker_count;
+}
 
+int Scheduler::getTraceCapacity() const {
+    return tracing ? workers[0]->getTrace()->getCapacity() : 0;
+}
 
+int Scheduler::copyTrace(int worker, TraceRing::Record *out) const {
+    return workers[worker]->getTrace()->copy(out);
+}
 
+/*
+ * takes the thread out of the wait queue and the timers it is in (an entry in a ready line is left stale)
+ */
+void Scheduler::unlinkThread(Thread *thread) {
+    if (thread->getWaiter() != nullptr) {
+        // the poller counts the threads waiting for fds
+        if (!poller->removeWaiter(thread->getWaiter()))
+            WaitQueue::removeAll(thread->getWaiter());
+        thread->setWaiter(nullptr);
+    }
+    sleeping->remove(thread->getSleepTimer());
+    timers->remove(thread->getWakeTimer());
+}
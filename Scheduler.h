@@ -6,56 +6,248 @@
 #define OS_EX2_SCHEDULER_H
 
 #include "Thread.h"
+#include "ThreadTable.h"
+#include "WaitQueue.h"
+#include "Poller.h"
+#include "WakeInbox.h"
+#include "Worker.h"
+#include "SpinLock.h"
 #include "uthreads.h"
-#include <map>
-#include <list>
+#include <atomic>
 #include <stdio.h>
 #include <signal.h>
 #include <sys/time.h>
 
+#define IDLE_WAIT_USECS 10000 /* how long an idle worker sleeps before looking for work again */
+#define POLL_INTERVAL_SWITCHES 16 /* scheduling decisions between two looks for ready fds */
+
 class Scheduler {
 private:
-    Thread *running;
-    std::list<Thread*> *ready;
-    std::map<int,Thread*> *blocked;
-    std::map<int,int> *sleeping;
-    std::map<int,Thread*> *threads;
+    Worker **workers;
+    const int worker_count;
+    ThreadTable *threads;
+    TimerHeap *sleeping;
+    TimerHeap *timers; // the CLOCK_MONOTONIC deadlines of uthread_sleep_usec and of waits with a timeout
     const int quant_len;
+    const int levels; // MLFQ priority levels, 1 for plain round robin
+    const int boost_period;
+    std::atomic<int> boosts; // priority boosts so far
+    std::atomic<int> next_boost; // the quantum of the next boost
     struct sigaction sa;
     struct itimerval timer_data;
-    int total_quantum_counter;
-    int next_sleep_check;
-    Thread* terminated = nullptr;
+    std::atomic<int> total_quantum_counter;
+    const bool collect_stats;
+    const bool tickless; // see programTimer
+    const bool tracing; // the workers keep a scheduler trace (see uthread_trace_dump)
+    const int manual_ticks; // the ticks of a level 0 quantum in manual tick mode (see tick), 0 if a timer ends quantums
+    int ticks_left; // the ticks left of the running thread's quantum, in manual tick mode
+    std::atomic<unsigned> work_epoch; // bumped whenever a thread becomes ready while workers are idle, they wait on it
+    std::atomic<int> idle_workers;
+    Poller *poller;
+    std::atomic<bool> poll_blocked; // an idle worker waits in the poller rather than on work_epoch
+    WakeInbox *inbox; // the resumes posted from outside the scheduler (see postResume)
+
+    static SpinLock state_lock;
+    static bool multicore;
 
     /*
      * initialize/restart the timer_data to send SIGVTALRM after a fixed amount of microseconds specified
      * in the constructor (quantum_length).
      */
-    void runTimer();
+    void runTimer(Worker*);
+
+    /*
+     * tickless scheduling: sets the timer of the worker to tick every quantum while there is something to preempt
+     * the running thread for (ready threads, quantum sleepers or fd waiters), to go off once at the next
+     * CLOCK_MONOTONIC deadline otherwise, and stops it if there is no deadline either.
+     */
+    void programTimer(Worker*);
+
+    /*
+     * returns the MLFQ level of the thread, moving it to the highest level first if there was a boost
+     * since its level was set. only the threads in the ready queues are moved by the boost itself.
+     */
+    int currentLevel(Thread*);
+
+    /*
+     * moves every thread back to the highest level, so threads that were demoted cannot starve. each worker moves
+     * up its own ready threads the next time it looks for one (see Worker::boostReady).
+     */
+    void boostThreads();
+
+    /*
+     * run the given thread, which the worker claimed (see Thread::claim), on the worker and initialize its
+     * timer_data. called without the lock.
+     * @param preempted true if the thread running on the worker is being preempted at the end of its quantum
+     * @param run_next true if the thread running on the worker is to run next once it is READY and off the CPU,
+     * ahead of the ready queue
+     */
+    void runThread(Worker*, Thread *thread, bool preempted = false, bool run_next = false);
+
+    /*
+     * run the next unblocked thread in line, or the worker's idle thread if there is none. called without the lock.
+     * the running thread runs on if it is READY (it yielded, or was woken before it got off the CPU) and no other
+     * thread is.
+     */
+    void runNextThread(Worker*, bool preempted = false);
+
+    /*
+     * runNextThread for the calls made with the lock held: releases it for the switch, and takes it again once the
+     * running thread resumes
+     */
+    void runNextThreadLocked(Worker*);
+
+    /*
+     * if stats are collected: charges the CPU time the worker used since its last charge to the thread
+     * running on it, which is about to stop running
+     */
+    void chargeRunning(Worker*);
+
+    /*
+     * if stats are collected: charges the CPU time the worker used since its last charge to the scheduler,
+     * and counts a switch out of the given thread
+     */
+    void recordSwitch(Worker*, Thread *previous, bool preempted);
+
+    /*
+     * claims the next thread to run from the worker's ready line (or another worker's), carrying out what
+     * other workers asked of the threads on the way. returns nullptr if there is nothing to run.
+     * called without the lock, which it takes only for the posted resumes, the deadlines and fds, and the requests.
+     */
+    Thread *pickNextThread(Worker*);
+
+    /*
+     * claims the first thread of the worker's ready line that is still READY, dropping the stale entries before it
+     * (see Thread::takeFromQueue). returns nullptr if there is none.
+     */
+    Thread *takeReady(Worker*);
+
+    /*
+     * moves half of the ready line of the worker with the longest one to the given worker (see Worker::stealFrom)
+     * @return true if anything was moved
+     */
+    bool stealThreads(Worker*);
+
+    /*
+     * pushes the thread, which the caller made READY (see Thread::makeReady), to the worker's ready line, and
+     * makes sure it gets to run: the running thread's timer is set to preempt it, and an idle worker is woken
+     * @param run_next put it in the slot of the thread to run next rather than at the tail
+     */
+    void queueReady(Worker*, Thread *thread, bool run_next = false);
 
     /*
-     * run the next unblocked thread in line
+     * suspend the running thread and run the worker's idle loop
      */
-    void runNextThread();
+    void switchToIdle(Worker*);
 
     /*
-     * remove an existing thread from the Scheduler's databases
+     * wakes the threads whose CLOCK_MONOTONIC deadline passed: ends their sleep, or the wait they waited with
+     * a timeout (see Waiter::expire)
      */
-    void removeThread(Thread*);
+    void handleTimers();
+
+    /*
+     * carries out the resumes posted to the inbox, in the order they were posted. IDs that no longer belong to the
+     * thread they were posted for (terminated, or reused since) are dropped.
+     */
+    void handleInbox();
+
+    /*
+     * how long an idle worker may wait for work, in nanoseconds: until the next deadline, IDLE_WAIT_USECS at most
+     */
+    long long idleWaitNsecs();
+
+    /*
+     * carries out the posted resumes and wakes the threads whose CLOCK_MONOTONIC deadline passed, taking the lock
+     * only if there are any. called without the lock.
+     */
+    void handleDue();
+
+    /*
+     * wakes the threads whose fds became ready, if threads wait for fds and no other worker is polling.
+     * never waits. called without the lock.
+     */
+    void pollIO(Worker*);
+
+    /*
+     * wakes an idle worker, if there is one, after a thread became ready
+     */
+    void notifyWork();
+
+    /*
+     * true if some worker has a ready thread (or a stale entry), or resumes were posted. needs no lock.
+     */
+    bool isWorkAvailable() const;
+
+    /*
+     * takes the thread out of the wait queue and the timers it is in (an entry in a ready line is left stale)
+     */
+    void unlinkThread(Thread*);
+
+    /*
+     * ends the given thread, which the caller made TERMINATED (it is not running, or is running, but is switched
+     * away from right after): it leaves the Scheduler's databases and gives its ID back, unless it stays a zombie
+     * until it is joined. a thread waiting to join it is woken up.
+     * @return true if the thread is to be released (see Thread::release), false if it is a zombie
+     */
+    bool endThread(Thread*);
+
+    /*
+     * appends a record about the given thread (or nullptr) to the calling worker's trace, if the scheduler is traced
+     */
+    void trace(TraceEvent event, Thread *thread, int arg = 0);
+
+    /*
+     * the idle thread of worker 0 starts here
+     */
+    static void idleEntry(void *worker);
 
 public:
     /**
      * create a Scheduler object that enable managing new user level threads. a helper class for uthread.
+     * the calling kernel thread becomes worker 0, and the main thread runs on it.
      *
      * @param quantum_length the length of a cycle for running a thread
+     * @param max_threads the maximal number of concurrent threads, the main thread included
+     * @param worker_count the number of kernel threads running threads (M:N scheduling if more than 1)
+     * @param levels the number of MLFQ priority levels: a thread that uses up its quantum drops a level,
+     * the ready threads of a higher level always run first, and level n gets quantum_length * 2^n.
+     * 1 is plain round robin.
+     * @param boost_period the number of quantums between moving every thread back to the highest level
+     * (0 for never)
+     * @param collect_stats collect the statistics of uthread_get_stats
+     * @param tickless only run the timer while there is something to preempt for (see programTimer)
+     * @param manual_ticks if positive, no timer is armed and a quantum lasts manual_ticks calls to tick (at level 0)
+     * @param trace_events the number of records each worker keeps in its scheduler trace, 0 for no trace
      */
-    explicit Scheduler(int quantum_length, struct sigaction sa);
+    Scheduler(int quantum_length, int max_threads, int worker_count, int levels, int boost_period,
+              bool collect_stats, bool tickless, int manual_ticks, int trace_events, struct sigaction sa);
 
     /**
-     * a simple destructor
+     * a simple destructor. must not be used while other workers are running.
      */
     ~Scheduler();
 
+    /**
+     * starts the kernel threads of workers 1 and up. they stay idle until there are threads to steal.
+     */
+    void startWorkers();
+
+    /**
+     * true if threads run on more than one kernel thread
+     */
+    static bool isMulticore();
+
+    /**
+     * the lock over the Scheduler's shared state: the thread table, the timers, the wait queues and the waits
+     * of the threads, and the requests. it is only taken inside critical sections, and never held across a
+     * context switch: a call that switches away with it releases it first, and takes it again once its thread
+     * resumes. the ready queues, picking the next thread, yields and preemptions do without it.
+     * without M:N scheduling there is no other kernel thread, and it is a no-op.
+     */
+    static void lock();
+    static void unlock();
+
     /**
      * returns the Thread object related to the given ID
      * @return
@@ -63,19 +255,23 @@ public:
     Thread* getThreadByID(int) const;
 
     /**
-     * sets the status of the given thread to RUNNING run it and initialize its timer_data
-     * @param thread
+     * chang the status of the given time to ready, and adding it to the end of the ready line. the running thread is
+     * added once the worker switched off it (see finishSwitch). needs no lock.
      */
-    void runThread(Thread *thread);
+    void setReady(Thread*);
 
     /**
-     * chang the status of the given time to ready, and adding it to the end of the ready line.
+     * resumes the thread with the given ID (which is below getMaxThreads) at the next scheduling decision, like
+     * unblockThread. takes no lock and touches no scheduler state, so any kernel thread may call it, from a signal
+     * handler too: the ID is added to the inbox with its current generation, and an idle worker is woken to take it
+     * (in tickless mode, worker 0 is interrupted if no worker is idle).
      */
-    void setReady(Thread*);
+    void postResume(int tid);
 
     /**
      * sets the status of the given thread into BLOCKED, effectively preventing its running until a
-     * different thread unblocks it.
+     * different thread unblocks it. a thread running on another worker is blocked by that worker,
+     * as soon as it can be interrupted.
      */
     void blockThread(Thread*);
 
@@ -84,15 +280,82 @@ public:
      */
     void sleepCurrentThread(int);
 
+    /**
+     * makes the running thread sleep until the given CLOCK_MONOTONIC time, in nanoseconds
+     */
+    void sleepCurrentThreadUntil(long long deadline);
+
+    /**
+     * moves the running thread to the end of the ready line and runs the next thread in line.
+     * does nothing if no other thread is ready at the running thread's level or above.
+     */
+    void yieldCurrentThread();
+
     /**
      * remove the BLOCK status from the given block, (not necessarily making it ready)
      */
     void unblockThread(Thread*);
 
     /**
-     * terminate and delete the given thread
+     * makes the running thread wait until wakeWaiter is called with the given waiter, which the caller
+     * already put in the wait queue of what the thread waits for.
+     * @param hand_to a READY thread to run next instead of the next thread in line, if no worker claimed it
+     * yet (the thread the caller just woke), or nullptr
+     * @param deadline the CLOCK_MONOTONIC time (in nanoseconds) at which the wait times out, 0 for never
+     */
+    void waitCurrentThread(Waiter *waiter, Thread *hand_to = nullptr, long long deadline = 0);
+
+    /**
+     * the wait of the given thread no longer times out
+     */
+    void cancelTimeout(Thread*);
+
+    /**
+     * takes the waiter (and its siblings) out of its wait queue, if it is still in one, and ends its thread's
+     * wait (and its timeout): the thread becomes READY, or stays BLOCKED if it was blocked while waiting.
+     */
+    void wakeWaiter(Waiter *waiter);
+
+    /**
+     * makes the running thread wait until the fd becomes readable (or writable), like waitCurrentThread.
+     * @return false if the fd cannot be polled (errno is set), in which case the thread keeps running
+     */
+    bool waitForFd(int fd, bool write, Waiter *waiter);
+
+    /**
+     * runs the given thread right away, if it is READY and no worker claimed it yet, and puts the running thread
+     * in the slot of the thread to run next so it resumes right after. does nothing otherwise.
+     */
+    void switchToThread(Thread*);
+
+    /**
+     * terminate and delete the given thread. a thread running on another worker is terminated by that
+     * worker, as soon as it can be interrupted.
+     * @param specific if not nullptr, the uthread-local values of a thread that was stopped right away (not
+     * running) are handed over through it, for the caller to delete. a thread that runs keeps them until it is
+     * deleted.
      */
-    void terminateThread(Thread*);
+    void terminateThread(Thread*, SpecificValue **specific = nullptr);
+
+    /**
+     * deletes a zombie thread (see Thread::isJoinable), once it was joined or detached
+     */
+    void reapThread(Thread*);
+
+    /**
+     * deletes the threads on the reaper list of the worker, all at once (see Worker::pushTerminated), under the
+     * lock. called without it, right after every switch and from the timer and idle loop, never on the stack
+     * of a thread on the list.
+     */
+    void reapTerminated(Worker*);
+
+    /**
+     * ends a switch on the worker, once it is off the stack of the thread it switched from: queues that thread if
+     * it became READY meanwhile, or has it deleted if it was released (see Thread::leaveCpu), and reaps the
+     * worker's terminated threads. called without the lock by the thread that was switched to, right after it
+     * resumes (or starts).
+     */
+    void finishSwitch(Worker*);
 
     /**
      * reruns the currently running thread.
@@ -108,19 +371,112 @@ public:
     int addNewThread(Thread*);
 
     /**
-     * this function is called whenever the timer_data expires.
+     * returns true if another thread (or count more threads) can be added without exceeding the thread limit
+     */
+    bool canAddThread(int count = 1) const;
+
+    /**
+     * prepares for adding count threads at once: makes room for them in the thread table and maps their stacks
+     * @return false if the stacks could not be mapped
+     */
+    bool reserveThreads(int count);
+
+    /**
+     * returns the maximal number of concurrent threads
+     */
+    int getMaxThreads() const;
+
+    /**
+     * this function is called whenever the timer_data of the calling worker expires, or when another
+     * worker interrupts it. the running thread used up its quantum, and drops an MLFQ level.
+     * in tickless mode a tick before the end of the running thread's quantum only handles deadlines and fds.
+     * called without the lock.
      * @param sig unused
      */
     void timerHandler(int sig);
+
+    /**
+     * manual tick mode: counts a tick of the running thread's quantum, and once the quantum is used up acts like
+     * timerHandler. must only be called from a thread, not from the idle loop, and without the lock.
+     */
+    void tick();
+
+    /**
+     * true if quantums are ended by tick rather than by a timer
+     */
+    bool isManualTick() const;
+
+    /**
+     * moves every thread whose sleep is over (and is not also BLOCKED) to the ready queue.
+     */
     void handleSleeping();
 
+    /**
+     * the idle loop of a worker: runs whatever becomes ready on the worker, and sleeps in between.
+     * called without the lock, never returns.
+     */
+    void idleLoop(Worker*);
 
     /**
-     * returns the amount of quantums passed by know (not include the currebt)
+     * returns the amount of quantums passed by know (not include the currebt). needs no lock.
      * @return
      */
     int getTotalQuantumCycles() const;
 
+    /**
+     * true if statistics are collected
+     */
+    bool isCollectingStats() const;
+
+    /**
+     * fills stats with the statistics of the given thread, its CPU time up to now included if it is running on
+     * the calling worker
+     */
+    void getStats(Thread*, uthread_stats *stats) const;
+
+    /**
+     * fills stats with the statistics of the whole library
+     */
+    void getGlobalStats(uthread_global_stats *stats) const;
+
+    /**
+     * true if the workers keep a scheduler trace
+     */
+    bool isTracing() const;
+
+    int getWorkerCount() const;
+
+    /**
+     * the number of records the trace of each worker keeps
+     */
+    int getTraceCapacity() const;
+
+    /**
+     * copies the trace of the given worker to out, oldest record first. needs no lock.
+     * @param out room for getTraceCapacity() records
+     * @return the number of records copied
+     */
+    int copyTrace(int worker, TraceRing::Record *out) const;
+
 };
 
+inline bool Scheduler::isMulticore() {
+    return multicore;
+}
+
+inline void Scheduler::lock() {
+    if (multicore)
+        state_lock.lock();
+}
+
+inline void Scheduler::unlock() {
+    if (multicore)
+        state_lock.unlock();
+}
+
+inline void Scheduler::trace(TraceEvent event, Thread *thread, int arg) {
+    if (tracing)
+        Worker::current()->getTrace()->append(event, thread != nullptr ? thread->getId() : -1, arg);
+}
+
 #endif //OS_EX2_SCHEDULER_H
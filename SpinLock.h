@@ -0,0 +1,38 @@
+#ifndef OS_EX2_SPINLOCK_H
+#define OS_EX2_SPINLOCK_H
+
+#include <atomic>
+#include <sched.h>
+
+#define SPINS_BEFORE_YIELD 1024
+
+/*
+ * A test-and-test-and-set lock. It is only held for short stretches inside critical sections, and never
+ * across a context switch, so a waiter spins for as long as the holder's kernel thread is on a CPU.
+ */
+class SpinLock {
+public:
+    SpinLock() : locked(false) {}
+
+    void lock() {
+        for (;;) {
+            if (!locked.exchange(true, std::memory_order_acquire))
+                return;
+            for (int spins = 0; locked.load(std::memory_order_relaxed); ++spins) {
+                if (spins < SPINS_BEFORE_YIELD)
+                    asm volatile("pause");
+                else
+                    sched_yield(); // the holder's kernel thread is probably not on a CPU
+            }
+        }
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked;
+};
+
+#endif //OS_EX2_SPINLOCK_H
@@ -0,0 +1,118 @@
+#include "StackPool.h"
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+
+/*
+ * the kernel's signal frame can be far larger than MINSIGSTKSZ on machines with big vector
+ * register files, so ask it for the real figure when it tells us.
+ */
+static size_t signalFrameSize() {
+    size_t size = MINSIGSTKSZ;
+#ifdef AT_MINSIGSTKSZ
+    size_t reported = getauxval(AT_MINSIGSTKSZ);
+    if (reported > size)
+        size = reported;
+#endif
+    return size;
+}
+
+StackPool::StackPool(size_t stack_size, size_t hot_limit) : hot_limit(hot_limit) {
+    page_size = (size_t) sysconf(_SC_PAGESIZE);
+    usable_size = (stack_size + signalFrameSize() + page_size - 1) / page_size * page_size;
+    slot_size = usable_size + page_size;
+    total_stacks = 0;
+    guard_pages = true;
+}
+
+StackPool::~StackPool() {
+    for (auto &region : regions)
+        munmap(region.base, region.length);
+}
+
+void StackPool::setGuardPages(bool guard_pages) {
+    this->guard_pages = guard_pages;
+}
+
+size_t StackPool::stackSize() const {
+    return usable_size;
+}
+
+char *StackPool::acquire() {
+    char *stack;
+    if (!hot.empty()) {
+        stack = hot.back();
+        hot.pop_back();
+        return stack;
+    }
+
+    if (cold.empty() && !grow())
+        return nullptr;
+    stack = cold.back();
+    cold.pop_back();
+    return stack;
+}
+
+void StackPool::release(char *stack) {
+    // the stack grows down, so an overflow writes the top of the page below it first
+    auto *below = (uint64_t *) stack - OVERFLOW_CHECK_WORDS;
+    for (int i = 0; !guard_pages && i < OVERFLOW_CHECK_WORDS; ++i) {
+        if (below[i] != 0) {
+            std::cerr << "system error: a thread overflowed its stack\n";
+            exit(1);
+        }
+    }
+
+    if (hot.size() < hot_limit) {
+        hot.push_back(stack);
+        return;
+    }
+
+    madvise(stack, usable_size, MADV_DONTNEED);
+    cold.push_back(stack);
+}
+
+bool StackPool::reserve(size_t count) {
+    size_t available = hot.size() + cold.size();
+    if (available >= count)
+        return true;
+
+    // whole regions' worth, so the pool keeps growing in the usual steps afterwards
+    size_t missing = count - available;
+    return grow((missing + STACKS_PER_REGION - 1) / STACKS_PER_REGION * STACKS_PER_REGION);
+}
+
+bool StackPool::grow(size_t stacks) {
+    size_t length = page_size + slot_size * stacks;
+    void *mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                         -1, 0);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    // the region's lowest page is a guard page, under the page of its lowest stack. with red zones that is the
+    // only one: a mapping per region rather than two per stack.
+    auto *base = (char *) mapping;
+    char *slots = base + page_size;
+    bool protect_failed = mprotect(base, page_size, PROT_NONE) != 0;
+    for (size_t i = 0; guard_pages && !protect_failed && i < stacks; ++i)
+        protect_failed = mprotect(slots + i * slot_size, page_size, PROT_NONE) != 0;
+    if (protect_failed) {
+        munmap(base, length);
+        return false;
+    }
+
+    // reserve up front so that release never has to allocate
+    total_stacks += stacks;
+    hot.reserve(total_stacks);
+    cold.reserve(total_stacks);
+    regions.push_back({base, length});
+
+    // lowest addresses on top, so they are handed out first
+    for (size_t i = stacks; i > 0; --i)
+        cold.push_back(slots + (i - 1) * slot_size + page_size);
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef OS_EX2_STACKPOOL_H
+#define OS_EX2_STACKPOOL_H
+
+#include <cstddef>
+#include <vector>
+
+#define STACKS_PER_REGION 64 /* stacks carved out of a single mmap */
+#define HOT_STACKS 64 /* released stacks kept resident, the rest are handed back with MADV_DONTNEED */
+#define OVERFLOW_CHECK_WORDS 16 /* words right below a stack that must still be zero when it is released */
+
+/*
+ * Hands out thread stacks carved from large mmap regions.
+ *
+ * Every stack sits right above a page of its own that the thread never uses. By default that page is a PROT_NONE
+ * guard page, and running off the end of a stack faults immediately, but each stack then splits the mapping in two,
+ * and vm.max_map_count (65530 by default) limits the pool to about 32k stacks. Without guard pages, only the lowest
+ * page of each region is PROT_NONE, and the pages below the stacks are red zones: they are never written (reading
+ * them costs no memory), and release checks that the words right below the stack are still zero, which catches an
+ * overflow of less than a page, late, as a diagnostic.
+ *
+ * Released stacks are never unmapped: they go back on a free list and the next acquire reuses them, so a
+ * spawn/terminate pair costs no system call and no malloc once the pool is warm. Up to hot_limit released stacks
+ * stay resident; beyond that their pages are dropped with madvise(MADV_DONTNEED) (the mapping itself stays, and is
+ * simply zero-filled again on the next use).
+ */
+class StackPool {
+public:
+    /**
+     * @param stack_size the number of bytes the thread itself may use. the stacks are larger than
+     * that: they are rounded up to whole pages and include room for the kernel's signal frame, since
+     * SIGVTALRM is delivered on the stack of whichever thread is running.
+     * @param hot_limit how many released stacks to keep resident
+     */
+    explicit StackPool(size_t stack_size, size_t hot_limit = HOT_STACKS);
+
+    /**
+     * makes the page below every stack a PROT_NONE guard page (the default), or a red zone. call it before the
+     * first acquire.
+     */
+    void setGuardPages(bool guard_pages);
+
+    /**
+     * unmaps all regions. every stack handed out by the pool becomes invalid.
+     */
+    ~StackPool();
+
+    /**
+     * returns the lowest usable address of a free stack, or nullptr if no memory could be mapped.
+     */
+    char *acquire();
+
+    /**
+     * returns a stack previously handed out by acquire to the pool. exits the process if the stack overflowed
+     * into the page below it.
+     */
+    void release(char *stack);
+
+    /**
+     * makes sure the next count acquires find a free stack, mapping the missing stacks in a single region.
+     * @return false if the region could not be mapped.
+     */
+    bool reserve(size_t count);
+
+    /**
+     * the usable size of every stack handed out by the pool (at least the requested stack_size).
+     */
+    size_t stackSize() const;
+
+private:
+    struct Region {
+        char *base;
+        size_t length;
+    };
+
+    size_t page_size;
+    size_t usable_size;
+    size_t slot_size; // usable_size plus the page below it
+    size_t hot_limit;
+    size_t total_stacks;
+    bool guard_pages;
+    std::vector<Region> regions;
+    std::vector<char*> hot;
+    std::vector<char*> cold;
+
+    /**
+     * maps another region of the given number of stacks (STACKS_PER_REGION by default) and puts them all on
+     * the cold list.
+     * @return false if the region could not be mapped.
+     */
+    bool grow(size_t stacks = STACKS_PER_REGION);
+};
+
+#endif //OS_EX2_STACKPOOL_H
@@ -1,32 +1,100 @@
 #include "Thread.h"
-#include <set>
+#include "Scheduler.h"
+#include <cerrno>
 #include <thread>
 #include <iostream>
 
 using namespace std;
 Thread::Thread_ID_Maker *Thread::threadIdMaker = new Thread::Thread_ID_Maker();
+StackPool *Thread::stackPool = new StackPool(STACK_SIZE);
+bool Thread::stats_enabled = false;
 
-Thread::Thread(thread_entry_point entryPoint) : id(Thread::threadIdMaker->getNewID()) {
+/*
+ * the field of stats that counts the time spent in the given state, nullptr if it is not counted
+ */
+static long long *stateTime(uthread_stats *stats, State state) {
+    switch (state) {
+        case READY:
+            return &stats->ready_nsecs;
+        case BLOCKED:
+        case WAITING:
+            return &stats->blocked_nsecs;
+        case SLEEPING:
+            return &stats->sleeping_nsecs;
+        default:
+            return nullptr;
+    }
+}
+
+Thread::Thread(thread_entry_point entryPoint) : Thread(entryPoint, nullptr, nullptr) {}
+
+Thread::Thread(thread_start_routine start_routine, void *arg) : Thread(nullptr, start_routine, arg) {
+    joinable = true;
+}
+
+Thread::Thread(thread_entry_point entryPoint, thread_start_routine start_routine, void *arg) :
+        entry_point(entryPoint), start_routine(start_routine), arg(arg), id(Thread::threadIdMaker->getNewID()) {
+    id_released = false;
     state = State::READY;
+    result = nullptr;
+    joinable = false;
+    joiners = {};
+    specific = nullptr;
     total_run_time = 0;
-    environment = new __jmp_buf_tag;
-    if (entryPoint != nullptr) {
-        stack = new char[STACK_SIZE];
-        setNewEntryPoint(entryPoint);
+    stats = {};
+    state_since = stats_enabled ? clockNsecs(CLOCK_MONOTONIC) : 0;
+    critical_depth = 1; // the switch that first runs the thread is inside a critical section
+    worker = nullptr;
+    request = NO_REQUEST;
+    level = 0;
+    level_boost = 0;
+    saved_errno = 0;
+    sleep_timer.thread = this;
+    wake_timer.thread = this;
+    waiter = nullptr;
+    stack = nullptr;
+    next_terminated = nullptr;
+    // the main thread keeps running on the regular stack, its context is filled on its first switch
+    if (entryPoint != nullptr || start_routine != nullptr) {
+        // a thread left without a stack is deleted by its creator, see hasStack
+        stack = stackPool->acquire();
+        if (stack != nullptr)
+            context.init(stack, stackPool->stackSize(), Thread::run, this);
     }
-    else {
-        sigsetjmp(environment, 1);
-        sigemptyset(&environment->__saved_mask);
+}
+
+Thread::Thread(void (*idle_loop)(void *), Worker *worker) : entry_point(nullptr), start_routine(nullptr),
+        arg(nullptr), id(-1), worker(worker) {
+    id_released = true;
+    state = State::RUNNING;
+    result = nullptr;
+    joinable = false;
+    joiners = {};
+    specific = nullptr;
+    total_run_time = 0;
+    stats = {};
+    state_since = 0;
+    critical_depth = 1; // nothing ever preempts an idle thread
+    request = NO_REQUEST;
+    level = 0;
+    level_boost = 0;
+    saved_errno = 0;
+    waiter = nullptr;
+    stack = nullptr;
+    next_terminated = nullptr;
+    if (idle_loop != nullptr) {
+        stack = stackPool->acquire();
+        if (stack != nullptr)
+            context.init(stack, stackPool->stackSize(), idle_loop, worker);
     }
 }
 
 Thread::~Thread() {
-    delete environment;
-
-    if (id != 0) {
+    if (id > 0 && !id_released)
         threadIdMaker->addIDtoList(id);
-        delete[] stack;
-    }
+    if (stack != nullptr)
+        stackPool->release(stack);
+    delete[] specific;
 }
 
 int Thread::getId() const {
@@ -34,101 +102,325 @@ int Thread::getId() const {
 }
 
 State Thread::getState() const {
-    return state;
+    return (State) (state.load() & STATE_MASK);
+}
+
+void Thread::countStateTime(State left) {
+    if (!stats_enabled)
+        return;
+    // getStats may read the statistics from another worker meanwhile
+    long long now = clockNsecs(CLOCK_MONOTONIC);
+    long long *state_time = stateTime(&stats, left);
+    if (state_time != nullptr)
+        __atomic_store_n(state_time, *state_time + now - state_since, __ATOMIC_RELAXED);
+    __atomic_store_n(&state_since, now, __ATOMIC_RELAXED);
 }
 
 void Thread::setState(State new_state) {
-    state = new_state;
+    int word = state.load();
+    countStateTime((State) (word & STATE_MASK));
+    while (!state.compare_exchange_weak(word, (word & ~STATE_MASK) | new_state)) {}
+}
+
+bool Thread::changeState(State expected, State new_state) {
+    int word = state.load();
+    do {
+        if ((word & STATE_MASK) != expected)
+            return false;
+    } while (!state.compare_exchange_weak(word, (word & ~STATE_MASK) | new_state));
+    countStateTime(expected);
+    return true;
+}
+
+bool Thread::makeReady() {
+    // only the thread's flags may change meanwhile, so its time is counted up front, before another worker can
+    // claim it
+    int word = state.load();
+    countStateTime((State) (word & STATE_MASK));
+    int ready;
+    do {
+        ready = (word & ~STATE_MASK) | READY;
+        if ((word & (QUEUED | ON_CPU)) == 0)
+            ready |= QUEUED;
+    } while (!state.compare_exchange_weak(word, ready));
+    return (word & (QUEUED | ON_CPU)) == 0;
+}
+
+bool Thread::claim() {
+    int word = state.load();
+    do {
+        if ((word & STATE_MASK) != READY || (word & ON_CPU) != 0)
+            return false;
+    } while (!state.compare_exchange_weak(word, (word & ~STATE_MASK) | RUNNING | ON_CPU));
+    countStateTime(READY);
+    return true;
+}
+
+bool Thread::reclaim() {
+    return changeState(READY, RUNNING);
+}
+
+NextStep Thread::takeFromQueue() {
+    int word = state.load();
+    int taken;
+    bool claimed;
+    do {
+        claimed = (word & STATE_MASK) == READY && (word & ON_CPU) == 0;
+        taken = claimed ? (word & ~(STATE_MASK | QUEUED)) | RUNNING | ON_CPU : word & ~QUEUED;
+    } while (!state.compare_exchange_weak(word, taken));
+    if (claimed) {
+        countStateTime(READY);
+        return STEP_RUN;
+    }
+    return (taken & (RELEASED | ON_CPU)) == RELEASED ? STEP_DELETE : STEP_NONE;
+}
+
+NextStep Thread::leaveCpu() {
+    int word = state.load();
+    int left;
+    do {
+        left = word & ~ON_CPU;
+        if ((word & STATE_MASK) == READY && (word & QUEUED) == 0)
+            left |= QUEUED;
+    } while (!state.compare_exchange_weak(word, left));
+    if ((left & QUEUED) != 0 && (word & QUEUED) == 0)
+        return STEP_QUEUE;
+    return (left & (RELEASED | QUEUED)) == RELEASED ? STEP_DELETE : STEP_NONE;
+}
+
+bool Thread::release() {
+    return (state.fetch_or(RELEASED) & (QUEUED | ON_CPU)) == 0;
 }
 
 void Thread::removeID() {
     threadIdMaker->addIDtoList(id);
+    id_released = true;
+}
+
+void Thread::enableStats() {
+    stats_enabled = true;
+}
+
+bool Thread::reserveStacks(int count) {
+    return stackPool->reserve(count);
+}
+
+void Thread::dropGuardPages() {
+    stackPool->setGuardPages(false);
+}
+
+bool Thread::hasStack() const {
+    return stack != nullptr;
+}
+
+void Thread::reserveIDs(int count) {
+    threadIdMaker->reserve(count);
+}
+
+void Thread::getStats(uthread_stats *out) const {
+    // the worker running the thread may update them meanwhile
+    out->cpu_nsecs = __atomic_load_n(&stats.cpu_nsecs, __ATOMIC_RELAXED);
+    out->ready_nsecs = __atomic_load_n(&stats.ready_nsecs, __ATOMIC_RELAXED);
+    out->blocked_nsecs = __atomic_load_n(&stats.blocked_nsecs, __ATOMIC_RELAXED);
+    out->sleeping_nsecs = __atomic_load_n(&stats.sleeping_nsecs, __ATOMIC_RELAXED);
+    out->voluntary_switches = __atomic_load_n(&stats.voluntary_switches, __ATOMIC_RELAXED);
+    out->involuntary_switches = __atomic_load_n(&stats.involuntary_switches, __ATOMIC_RELAXED);
+    long long *state_time = stateTime(out, getState());
+    if (state_time != nullptr)
+        *state_time += clockNsecs(CLOCK_MONOTONIC) - __atomic_load_n(&state_since, __ATOMIC_RELAXED);
+}
+
+void Thread::addCpuTime(long long nsecs) {
+    __atomic_store_n(&stats.cpu_nsecs, stats.cpu_nsecs + nsecs, __ATOMIC_RELAXED);
+}
+
+void Thread::countSwitch(bool involuntary) {
+    long long *count = involuntary ? &stats.involuntary_switches : &stats.voluntary_switches;
+    __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
 }
 
 void Thread::incrementQuantumAmount(){
-    total_run_time++;
+    __atomic_store_n(&total_run_time, total_run_time + 1, __ATOMIC_RELAXED);
+}
+
+void *Thread::getResult() const {
+    return result;
+}
+
+bool Thread::isJoinable() const {
+    return joinable;
+}
+
+void Thread::setJoinable(bool new_joinable) {
+    joinable = new_joinable;
+}
+
+uthread_wait_queue *Thread::getJoiners() {
+    return &joiners;
+}
+
+SpecificValue *Thread::getSpecific() const {
+    return specific;
+}
+
+SpecificValue *Thread::createSpecific() {
+    if (specific == nullptr)
+        specific = new SpecificValue[UTHREAD_KEYS_MAX]();
+    return specific;
+}
+
+SpecificValue *Thread::takeSpecific() {
+    SpecificValue *taken = specific;
+    specific = nullptr;
+    return taken;
+}
+
+Thread *Thread::getNextTerminated() const {
+    return next_terminated;
+}
+
+void Thread::setNextTerminated(Thread *next) {
+    next_terminated = next;
+}
+
+int Thread::getCriticalDepth() const {
+    return critical_depth;
+}
+
+void Thread::setCriticalDepth(int depth) {
+    critical_depth = depth;
+}
+
+Worker *Thread::getWorker() const {
+    return worker;
+}
+
+void Thread::setWorker(Worker *new_worker) {
+    worker = new_worker;
+}
+
+Request Thread::getRequest() const {
+    return request;
+}
+
+void Thread::setRequest(Request new_request) {
+    request = new_request;
+}
+
+int Thread::getLevel() const {
+    return level.load(std::memory_order_relaxed);
+}
+
+int Thread::getLevelBoost() const {
+    return level_boost;
+}
+
+void Thread::setLevel(int new_level, int boost) {
+    level.store(new_level, std::memory_order_relaxed);
+    level_boost = boost;
+}
+
+void Thread::saveErrno() {
+    saved_errno = errno;
+}
+
+void Thread::restoreErrno() const {
+    errno = saved_errno;
 }
 
 int Thread::getRunTime() const {
-    return total_run_time;
+    return __atomic_load_n(&total_run_time, __ATOMIC_RELAXED);
+}
+
+TimerNode *Thread::getSleepTimer() {
+    return &sleep_timer;
+}
+
+TimerNode *Thread::getWakeTimer() {
+    return &wake_timer;
+}
+
+bool Thread::isSleeping() const {
+    // a waiting thread's wake timer is the timeout of its wait
+    return sleep_timer.isQueued() || (wake_timer.isQueued() && waiter == nullptr);
+}
+
+Waiter *Thread::getWaiter() const {
+    return waiter;
+}
+
+void Thread::setWaiter(Waiter *new_waiter) {
+    waiter = new_waiter;
 }
 
 /*
  * returns lowest available id.
  */
 int Thread::Thread_ID_Maker::getNewID() {
-    if (available_ids->empty()) return ++last_id;
-    auto lowest = available_ids->begin();
-    if (*lowest < last_id) {
-        *available_ids->erase(lowest);
-        return *lowest;
-    }
-    else {
-        available_ids->clear();
-        return ++last_id;
+    for (size_t i = first_summary; i < summary.size(); ++i) {
+        if (summary[i] == 0)
+            continue;
+        first_summary = i;
+        size_t word = i * 64 + __builtin_ctzll(summary[i]);
+        int bit = __builtin_ctzll(free_ids[word]);
+        free_ids[word] &= free_ids[word] - 1;
+        if (free_ids[word] == 0)
+            summary[i] &= ~(1ULL << (word % 64));
+        return (int) (word * 64 + bit);
     }
+    first_summary = summary.size();
+
+    // no ID below end is available
+    int id = end++;
+    reserve(end);
+    return id;
 }
 
 /*
  * adds id of eliminated thread to the list of available thread ids
  */
 void Thread::Thread_ID_Maker::addIDtoList(int eliminated) {
-    if (available_ids->count(eliminated) != 0)
+    if (eliminated < 0 || eliminated >= end)
         return;
-    else if (eliminated == last_id)
-        --last_id;
-    else
-        available_ids->insert(eliminated);
-}
-
-
-Thread::Thread_ID_Maker::Thread_ID_Maker() {
-    last_id = -1;
-    available_ids = new set<int>();
+    size_t word = eliminated / 64;
+    uint64_t bit = 1ULL << (eliminated % 64);
+    if (free_ids[word] & bit)
+        return;
+    free_ids[word] |= bit;
+    summary[word / 64] |= 1ULL << (word % 64);
+    if (word / 64 < first_summary)
+        first_summary = word / 64;
 }
 
-Thread::Thread_ID_Maker::~Thread_ID_Maker() {
-    delete available_ids;
+void Thread::Thread_ID_Maker::reserve(int count) {
+    size_t words = (count + 63) / 64;
+    if (words > free_ids.size()) {
+        free_ids.resize(words, 0);
+        summary.resize((words + 63) / 64, 0);
+    }
 }
 
-int Thread::saveRunStatus(){
-    return sigsetjmp(environment, 1);
-    //we do not save the masked signals
+Thread::Thread_ID_Maker::Thread_ID_Maker() {
+    first_summary = 0;
+    end = 0;
 }
 
-void Thread::restoreState() const{
-    sigset_t  temp = {0};
-    sigaddset(&temp, SIGVTALRM);
-    sigprocmask(SIG_UNBLOCK, &temp, nullptr);
-    siglongjmp(environment, 1);
+void Thread::switchTo(Thread &next) {
+    context.switchTo(next.context);
 }
 
-void Thread::setNewEntryPoint(thread_entry_point entry_point) {
-    sigset_t  temp = {0};
-    sigaddset(&temp, SIGVTALRM);
-    sigprocmask(SIG_BLOCK, &temp, nullptr);
-    sigsetjmp(environment, 1);
-    sigprocmask(SIG_UNBLOCK, &temp, nullptr);
+void Thread::run(void *thread) {
+    auto *self = (Thread *) thread;
+    // the first switch to the thread is over once it runs
+    Worker *worker = Worker::current();
+    worker->getScheduler()->finishSwitch(worker);
+    uthread_preempt_enable();
 
-    address_t sp = (address_t)stack + STACK_SIZE - sizeof(address_t);
-    auto pc = (address_t) entry_point;
-    (environment->__jmpbuf)[JB_SP] = translate_address(sp);
-    (environment->__jmpbuf)[JB_PC] = translate_address(pc);
-    sigemptyset(&(environment->__saved_mask));
-}
+    if (self->start_routine != nullptr)
+        self->result = self->start_routine(self->arg);
+    else
+        self->entry_point();
 
-/* A translation is required when using an address of a variable.
-   Use this as a black box in your code. */
-address_t Thread::translate_address(address_t addr)
-{
-    address_t ret;
-    asm volatile("xor    %%fs:0x30,%0\n"
-                 "rol    $0x11,%0\n"
-            : "=g" (ret)
-            : "0" (addr));
-    return ret;
+    // returning from the entry point has nowhere to go, so it ends the thread
+    uthread_terminate(self->getId());
 }
-
-
-
-
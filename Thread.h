@@ -1,26 +1,122 @@
 #ifndef OS_EX2_THREAD_H
 #define OS_EX2_THREAD_H
 
-#include <set>
-#include <csetjmp>
+#include <vector>
+#include <atomic>
+#include <cstdint>
 #include <thread>
 #include <signal.h>
 #include "uthreads.h"
+#include "Context.h"
+#include "StackPool.h"
+#include "TimerHeap.h"
+#include "Clock.h"
+
+/*
+ * WAITING: waiting for a mutex, a condition variable, a semaphore or a channel (see Waiter)
+ */
+enum State {READY, RUNNING, BLOCKED, SLEEPING, WAITING, TERMINATED};
+
+/*
+ * what another worker asked of a thread that was RUNNING at the time, to be carried out the next time
+ * the thread goes through its own worker's scheduler.
+ */
+enum Request {NO_REQUEST, BLOCK_REQUESTED, TERMINATE_REQUESTED};
+
+/*
+ * what is left to do with a thread taken off a run queue or off a CPU (see Thread::takeFromQueue and
+ * Thread::leaveCpu): nothing, run it (the caller claimed it), put it in a run queue, or delete it
+ */
+enum NextStep {STEP_NONE, STEP_RUN, STEP_QUEUE, STEP_DELETE};
 
-enum State {READY, RUNNING, BLOCKED, SLEEPING, TERMINATED};
 typedef void (*thread_entry_point)(void);
-typedef unsigned long address_t;
-#define JB_SP 6
-#define JB_PC 7
+typedef void *(*thread_start_routine)(void *);
+
+class Worker;
+struct Waiter;
+
+/*
+ * a thread's value for a uthread-local key. it is only the value of the key that currently has the index if seq
+ * matches the key's sequence number (see uthread_key_create), so deleting a key needs no pass over the threads.
+ */
+struct SpecificValue {
+    unsigned seq;
+    void *value;
+};
 
 class Thread{
 public:
     // we pass nullptr when creating main thread
     explicit Thread(thread_entry_point = nullptr);
+
+    /**
+     * creates a thread that runs start_routine(arg), and keeps what it returns (see uthread_spawn_arg)
+     */
+    Thread(thread_start_routine start_routine, void *arg);
+
+    /**
+     * creates the idle thread of a worker. it has no ID and is never registered with the scheduler.
+     * @param idle_loop the idle thread's code, called with worker. nullptr if the idle thread runs on
+     * the worker's own kernel thread stack, and is only switched out of, never started.
+     */
+    Thread(void (*idle_loop)(void *), Worker *worker);
+
     ~Thread();
+
+    /**
+     * false for the main thread, which runs on the regular stack, and for a thread whose stack could not be
+     * allocated: such a thread cannot run, and is deleted by its creator instead
+     */
+    bool hasStack() const;
+
     int getId() const;
+
+    /**
+     * the thread's state shares an atomic word with two flags: the thread has an entry in a run queue (see
+     * RunQueue), and a worker is on its stack (it runs, or a switch off it is not over yet). a READY thread is
+     * claimed to run by a compare-and-swap of the word, by any worker and without the scheduler's lock, so every
+     * change of the state is one too.
+     * setState is for a thread no other worker can claim meanwhile (it is not READY, or it runs on the calling
+     * worker), changeState only changes the state if it is the expected one.
+     */
     State getState() const;
     void setState(State);
+    bool changeState(State expected, State new_state);
+
+    /**
+     * makes the thread READY.
+     * @return true if the caller is to push it to a run queue: it has no entry in one, and no worker is on its stack
+     * (otherwise leaveCpu queues it once the worker is off it)
+     */
+    bool makeReady();
+
+    /**
+     * claim makes a READY thread RUNNING, for the calling worker to switch to it. it fails if the thread is not
+     * READY, or another worker is still on its stack. reclaim is for the thread running on the calling worker, that
+     * became READY before the worker switched off it.
+     * @return true if the thread was claimed
+     */
+    bool claim();
+    bool reclaim();
+
+    /**
+     * for an entry just taken off a run queue: claims the thread if it is READY (STEP_RUN), and otherwise drops the
+     * entry, which was stale (STEP_DELETE if the thread was released meanwhile)
+     */
+    NextStep takeFromQueue();
+
+    /**
+     * called once the worker that ran the thread is off its stack: STEP_QUEUE if it became READY meanwhile, and the
+     * caller is to push it, STEP_DELETE if it was released and is in no run queue
+     */
+    NextStep leaveCpu();
+
+    /**
+     * marks a terminated thread that left the thread table for deletion
+     * @return true if the caller is to delete it now. otherwise it is deleted by whoever takes its stale entry off
+     * a run queue, or by its worker once it is off its stack.
+     */
+    bool release();
 
     /**
      * add one to quantum count
@@ -30,31 +126,165 @@ public:
     int getRunTime() const;
 
     /**
-     * save the current state of the thraed (to stack)
+     * collect statistics in all threads from now on (see uthread_get_stats)
+     */
+    static void enableStats();
+
+    /**
+     * makes sure the next count threads created find a stack ready, mapping the missing ones at once
+     * @return false if the stacks could not be mapped
+     */
+    static bool reserveStacks(int count);
+
+    /**
+     * leaves the page below every thread stack unprotected, a red zone checked when the stack is released (see
+     * StackPool::setGuardPages). called before the first thread is created.
+     */
+    static void dropGuardPages();
+
+    /**
+     * makes room for the IDs below count, so handing them out never allocates
+     */
+    static void reserveIDs(int count);
+
+    /**
+     * fills stats with the thread's statistics, the time spent in its current state included
      */
-    int saveRunStatus();
+    void getStats(uthread_stats *stats) const;
 
     /**
-     * continue to run this thread
+     * adds to the CPU time the thread consumed, and counts one switch out of the thread
      */
-    void restoreState() const;
+    void addCpuTime(long long nsecs);
+    void countSwitch(bool involuntary);
 
     /**
-     * adds this ID to removed ID list
+     * the timer of uthread_sleep: its deadline is the quantum at which the thread should wake up,
+     * and it is queued for as long as the thread sleeps.
+     * (a sleeping thread may be BLOCKED at the same time, then its state is BLOCKED)
+     */
+    TimerNode *getSleepTimer();
+
+    /**
+     * the timer of uthread_sleep_usec and of waits with a timeout: its deadline is the CLOCK_MONOTONIC time
+     * (in nanoseconds) at which the thread should wake up, and it is queued for as long as it sleeps or waits.
+     */
+    TimerNode *getWakeTimer();
+
+    /**
+     * true if the thread sleeps (in uthread_sleep or uthread_sleep_usec), even if it is also BLOCKED
+     */
+    bool isSleeping() const;
+
+    /**
+     * the thread's place in the wait queue of a synchronization object, nullptr if it does not wait for
+     * one. a waiting thread may be BLOCKED at the same time, then its state is BLOCKED.
+     */
+    Waiter *getWaiter() const;
+    void setWaiter(Waiter *);
+
+    /**
+     * what the start routine of the thread returned, nullptr if it has none or did not return
+     */
+    void *getResult() const;
+
+    /**
+     * true if the thread stays a zombie once it terminates, until uthread_join collects its result (see
+     * uthread_spawn_arg). a zombie keeps its ID and its place in the thread table, with its state TERMINATED.
+     */
+    bool isJoinable() const;
+    void setJoinable(bool);
+
+    /**
+     * the queue of the thread waiting in uthread_join for this one to terminate (there is one at most)
+     */
+    uthread_wait_queue *getJoiners();
+
+    /**
+     * the thread's values of the uthread-local keys, UTHREAD_KEYS_MAX of them indexed by key, nullptr until
+     * createSpecific allocates them (when the thread first sets a value)
+     */
+    SpecificValue *getSpecific() const;
+    SpecificValue *createSpecific();
+
+    /**
+     * hands the thread's values over to the caller, who deletes them. the thread is left with none.
+     */
+    SpecificValue *takeSpecific();
+
+    /**
+     * the next thread in the reaper list of a worker (see Worker::pushTerminated)
+     */
+    Thread *getNextTerminated() const;
+    void setNextTerminated(Thread *);
+
+    /**
+     * the depth of the thread's nested critical sections (library calls and uthread_preempt_disable).
+     * while it is positive a SIGVTALRM only marks a preemption as pending on the thread's worker, and
+     * the preemption is carried out when the depth drops back to 0. it is only modified by the thread
+     * itself and by the SIGVTALRM handler interrupting it, so it needs no lock.
+     */
+    int getCriticalDepth() const;
+    void setCriticalDepth(int);
+
+    /**
+     * the worker the thread is running on, or last ran on. set by the worker that claimed the thread before it
+     * checks the thread's request, so a worker that asks something of a RUNNING thread and then interrupts the
+     * thread's worker never misses it.
+     */
+    Worker *getWorker() const;
+    void setWorker(Worker *);
+
+    Request getRequest() const;
+    void setRequest(Request);
+
+    /**
+     * the thread's priority level under MLFQ scheduling, 0 being the highest, and the number of the
+     * priority boost (see Scheduler::currentLevel) it was set after
+     */
+    int getLevel() const;
+    int getLevelBoost() const;
+    void setLevel(int level, int boost);
+
+    /**
+     * errno belongs to the kernel thread, so every switch stores it with the thread it belongs to
+     */
+    void saveErrno();
+    void restoreErrno() const;
+
+    /**
+     * suspend the calling thread (this one) and continue to run next.
+     * returns once some thread switches back to this one.
+     * the caller must be in a critical section.
+     */
+    void switchTo(Thread &next);
+
+    /**
+     * adds this ID to removed ID list, so a new thread may take it before this one is deleted (which may be later
+     * than it leaves the thread table, see release). the destructor does not release it again.
      */
     void removeID();
 
     /**
-     * internal class for providing lowest possible thread ID number
+     * internal class for providing lowest possible thread ID number.
+     *
+     * the free IDs below end are bits of a bitmap, one 64 bit word per 64 IDs, and a summary bitmap has a bit per
+     * word that has a free ID. the lowest free ID is found with find-first-set on the first non-empty summary word
+     * and then on the word it points to, IDs from end on are all free. nothing is allocated once reserve made room.
      */
     class Thread_ID_Maker {
-        std::set<int> *available_ids;
-        int last_id;
+        std::vector<uint64_t> free_ids;
+        std::vector<uint64_t> summary;
+        size_t first_summary; // no summary word before it has a bit set
+        int end; // one past the highest ID handed out so far
 
     public:
         Thread_ID_Maker();
 
-        ~Thread_ID_Maker();
+        /**
+         * makes room for the IDs below count
+         */
+        void reserve(int count);
 
         /**
         * returns lowest available id.
@@ -62,32 +292,60 @@ public:
         int getNewID();
 
         /**
-        * adds id of eliminated thread to the list of available thread ids
+        * adds id of eliminated thread to the list of available thread ids. an ID that is already available is
+        * ignored.
         */
         void addIDtoList(int);
     };
 
 private:
-    __jmp_buf_tag* environment;
+    static const int STATE_MASK = 0xff;
+    static const int QUEUED = 0x100; // an entry of the thread is in a run queue (maybe a stale one)
+    static const int ON_CPU = 0x200; // a worker is on the thread's stack
+    static const int RELEASED = 0x400; // to be deleted once neither flag is set
+
+    Context context;
+    thread_entry_point entry_point;
+    thread_start_routine start_routine;
+    void *arg;
+    void *result;
+    bool joinable;
+    uthread_wait_queue joiners;
+    SpecificValue *specific;
     const int id;
-    State state;
+    bool id_released; // removeID already gave the ID back
+    std::atomic<int> state; // a State, and the flags above
     int total_run_time;
+    uthread_stats stats;
+    long long state_since; // when the thread entered its current state, if stats are enabled
+    static bool stats_enabled;
+    volatile sig_atomic_t critical_depth;
+    std::atomic<Worker*> worker;
+    std::atomic<Request> request;
+    std::atomic<int> level; // read from stale run queue entries by other workers
+    int level_boost;
+    int saved_errno;
+    TimerNode sleep_timer;
+    TimerNode wake_timer;
+    Waiter *waiter;
     static Thread_ID_Maker *threadIdMaker;
+    static StackPool *stackPool;
     char *stack;
+    Thread *next_terminated; // reaper list link
+
+    Thread(thread_entry_point entry_point, thread_start_routine start_routine, void *arg);
 
     /**
-     * Prepares for sigsetjmp thread switch.
-     * @param entry_point the entry point for the thread about to be run
+     * adds the time since the thread entered the given state, which it is leaving, to its statistics
      */
-    void setNewEntryPoint(thread_entry_point entry_point);
+    void countStateTime(State left);
 
     /**
-     * Black Box: A translation is required when using an address of a variable.
-     * @param addr the address to translate
-     * @return the translated address
+     * the first code a new thread runs: leaves the critical section it was switched in from, calls
+     * the entry point (or the start routine, keeping its result), and terminates the thread if it returns.
+     * @param thread the Thread object being started
      */
-    static address_t translate_address(address_t addr);
-
+    static void run(void *thread);
 
 };
 
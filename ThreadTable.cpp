@@ -0,0 +1,60 @@
+#include "ThreadTable.h"
+
+#define INITIAL_SLOTS 64
+
+ThreadTable::ThreadTable(int max_threads) : generations(new std::atomic<unsigned>[max_threads]()),
+        max_threads(max_threads), count(0) {
+    slots.resize(max_threads < INITIAL_SLOTS ? max_threads : INITIAL_SLOTS, nullptr);
+}
+
+ThreadTable::~ThreadTable() {
+    delete[] generations;
+}
+
+bool ThreadTable::insert(Thread *thread) {
+    if (isFull())
+        return false;
+
+    int tid = thread->getId();
+    reserve(tid + 1);
+
+    slots[tid] = thread;
+    generations[tid].fetch_add(1, std::memory_order_release);
+    count++;
+    return true;
+}
+
+void ThreadTable::reserve(int end) {
+    if (end <= (int) slots.size())
+        return;
+
+    size_t new_size = slots.size() * 2;
+    while (new_size < (size_t) end)
+        new_size *= 2;
+    slots.resize(new_size, nullptr);
+}
+
+void ThreadTable::remove(Thread *thread) {
+    int tid = thread->getId();
+    if (get(tid) != thread)
+        return;
+
+    slots[tid] = nullptr;
+    count--;
+}
+
+int ThreadTable::size() const {
+    return count;
+}
+
+bool ThreadTable::isFull() const {
+    return count >= max_threads;
+}
+
+int ThreadTable::getMaxThreads() const {
+    return max_threads;
+}
+
+int ThreadTable::end() const {
+    return (int) slots.size();
+}
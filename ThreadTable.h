@@ -0,0 +1,96 @@
+#ifndef OS_EX2_THREADTABLE_H
+#define OS_EX2_THREADTABLE_H
+
+#include <atomic>
+#include <vector>
+#include "Thread.h"
+
+/*
+ * The registry of live threads: a dense array of slots indexed directly by thread ID.
+ *
+ * Lookup is a bounds check and an array access. The array grows (by doubling) only as far as the
+ * highest ID handed out, so a process that never uses many threads never pays for a large table.
+ * Each ID carries a generation counter, bumped whenever a new thread is registered under it, so code that keeps a
+ * (tid, generation) pair around can tell whether the tid still names the same thread. The generations are kept
+ * apart from the slots, in an array that never moves, so they can be read without the scheduler's lock.
+ */
+class ThreadTable {
+public:
+    /**
+     * @param max_threads the maximal number of threads that may be registered at once
+     */
+    explicit ThreadTable(int max_threads);
+    ~ThreadTable();
+
+    /**
+     * returns the thread registered under the given ID, or nullptr if there is none
+     */
+    Thread *get(int tid) const;
+
+    /**
+     * returns the thread registered under the given ID, or nullptr if there is none or if a new thread was
+     * registered under the ID since the given generation was read
+     */
+    Thread *get(int tid, unsigned generation) const;
+
+    /**
+     * returns the current generation of the given ID, which must be below the maximal number of threads. needs no
+     * lock: any kernel thread may call it, at any time.
+     */
+    unsigned getGeneration(int tid) const;
+
+    /**
+     * registers the thread under its own ID.
+     * @return false if the table is already holding max_threads threads
+     */
+    bool insert(Thread *thread);
+
+    /**
+     * makes room for the IDs below end, so inserting threads with those IDs never grows the table
+     */
+    void reserve(int end);
+
+    /**
+     * unregisters the given thread (nothing happens if its slot holds a different thread)
+     */
+    void remove(Thread *thread);
+
+    /**
+     * the number of registered threads
+     */
+    int size() const;
+
+    bool isFull() const;
+
+    int getMaxThreads() const;
+
+    /**
+     * one past the highest ID the table has room for. iterate 0..end() and skip empty slots with get().
+     */
+    int end() const;
+
+private:
+    std::vector<Thread *> slots;
+    std::atomic<unsigned> *generations; // max_threads of them
+    const int max_threads;
+    int count;
+};
+
+inline Thread *ThreadTable::get(int tid) const {
+    if (tid < 0 || tid >= (int) slots.size())
+        return nullptr;
+    return slots[tid];
+}
+
+inline Thread *ThreadTable::get(int tid, unsigned generation) const {
+    Thread *thread = get(tid);
+    if (thread == nullptr || generations[tid].load(std::memory_order_relaxed) != generation)
+        return nullptr;
+    return thread;
+}
+
+inline unsigned ThreadTable::getGeneration(int tid) const {
+    return generations[tid].load(std::memory_order_acquire);
+}
+
+#endif //OS_EX2_THREADTABLE_H
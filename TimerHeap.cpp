@@ -0,0 +1,73 @@
+#include "TimerHeap.h"
+
+TimerHeap::TimerHeap(int capacity) : earliest_deadline(LLONG_MAX) {
+    nodes.reserve(capacity);
+}
+
+void TimerHeap::push(TimerNode *node) {
+    nodes.push_back(node);
+    node->index = (int) nodes.size() - 1;
+    siftUp(node->index);
+    updateEarliest();
+}
+
+TimerNode *TimerHeap::pop() {
+    TimerNode *node = nodes.front();
+    remove(node);
+    return node;
+}
+
+void TimerHeap::remove(TimerNode *node) {
+    if (!node->isQueued())
+        return;
+
+    int index = node->index;
+    TimerNode *last = nodes.back();
+    nodes.pop_back();
+    node->index = -1;
+    if (last != node) {
+        // the last node fills the hole, and may belong either above or below it
+        place(last, index);
+        siftUp(index);
+        siftDown(last->index);
+    }
+    updateEarliest();
+}
+
+void TimerHeap::updateEarliest() {
+    earliest_deadline.store(nodes.empty() ? LLONG_MAX : nodes.front()->deadline, std::memory_order_relaxed);
+}
+
+void TimerHeap::place(TimerNode *node, int index) {
+    nodes[index] = node;
+    node->index = index;
+}
+
+void TimerHeap::siftUp(int index) {
+    TimerNode *node = nodes[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (nodes[parent]->deadline <= node->deadline)
+            break;
+        place(nodes[parent], index);
+        index = parent;
+    }
+    place(node, index);
+}
+
+void TimerHeap::siftDown(int index) {
+    TimerNode *node = nodes[index];
+    int count = (int) nodes.size();
+    for (;;) {
+        int child = 2 * index + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && nodes[child + 1]->deadline < nodes[child]->deadline)
+            child++;
+        if (node->deadline <= nodes[child]->deadline)
+            break;
+        place(nodes[child], index);
+        index = child;
+    }
+    place(node, index);
+}
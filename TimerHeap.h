@@ -0,0 +1,100 @@
+#ifndef OS_EX2_TIMERHEAP_H
+#define OS_EX2_TIMERHEAP_H
+
+#include <atomic>
+#include <climits>
+#include <vector>
+
+class Thread;
+
+/*
+ * An entry of a TimerHeap. Nodes are embedded in the object waiting for the deadline (a Thread), so
+ * queueing a timer allocates nothing, and the node remembers its position in the heap so it can be
+ * cancelled without searching for it.
+ */
+struct TimerNode {
+    long long deadline;
+    Thread *thread;
+    int index; // position in the heap, -1 when the node is not queued
+
+    TimerNode() : deadline(0), thread(nullptr), index(-1) {}
+
+    bool isQueued() const {
+        return index >= 0;
+    }
+};
+
+/*
+ * A binary min-heap of TimerNodes ordered by deadline.
+ *
+ * push, pop and remove are O(log n); looking at the earliest deadline is O(1), so checking for
+ * expired timers touches nothing but the timers that actually expired. The heap itself is used under
+ * the scheduler's lock, but its earliest deadline can be checked without it (see earliest).
+ */
+class TimerHeap {
+public:
+    /**
+     * @param capacity the number of nodes to make room for up front
+     */
+    explicit TimerHeap(int capacity = 0);
+
+    bool empty() const;
+
+    int size() const;
+
+    /**
+     * the node with the earliest deadline. the heap must not be empty.
+     */
+    TimerNode *top() const;
+
+    /**
+     * the deadline of top, LLONG_MAX if the heap is empty. any kernel thread may call it without the scheduler's lock,
+     * the result may be out of date by the time it returns.
+     */
+    long long earliest() const;
+
+    /**
+     * queues the node by its deadline. the node must not be queued already.
+     */
+    void push(TimerNode *node);
+
+    /**
+     * removes and returns the node with the earliest deadline. the heap must not be empty.
+     */
+    TimerNode *pop();
+
+    /**
+     * removes the node from the heap. nothing happens if it is not queued.
+     */
+    void remove(TimerNode *node);
+
+private:
+    std::vector<TimerNode*> nodes;
+    std::atomic<long long> earliest_deadline;
+
+    /**
+     * publishes the deadline of top for earliest, after a change of the heap
+     */
+    void updateEarliest();
+    void place(TimerNode *node, int index);
+    void siftUp(int index);
+    void siftDown(int index);
+};
+
+inline bool TimerHeap::empty() const {
+    return nodes.empty();
+}
+
+inline int TimerHeap::size() const {
+    return (int) nodes.size();
+}
+
+inline TimerNode *TimerHeap::top() const {
+    return nodes.front();
+}
+
+inline long long TimerHeap::earliest() const {
+    return earliest_deadline.load(std::memory_order_relaxed);
+}
+
+#endif //OS_EX2_TIMERHEAP_H
@@ -0,0 +1,93 @@
+#include "Trace.h"
+#include <unistd.h>
+
+uint64_t TraceRing::base_stamp = 0;
+long long TraceRing::base_nsecs = 0;
+
+static const char *const event_names[] = {"run", "idle", "ready", "block", "unblock", "sleep", "wait", "terminate",
+                                          "tick"};
+
+/*
+ * the smallest power of 2 that is at least count
+ */
+static uint32_t roundUp(int count) {
+    uint32_t size = 1;
+    while (size < (uint32_t) count)
+        size <<= 1;
+    return size;
+}
+
+TraceRing::TraceRing(int capacity) : records(new Record[roundUp(capacity)]()), mask(roundUp(capacity) - 1),
+        next(0) {
+    if (base_nsecs == 0) {
+        base_stamp = stamp();
+        base_nsecs = clockNsecs(CLOCK_MONOTONIC);
+    }
+}
+
+TraceRing::~TraceRing() {
+    delete[] records;
+}
+
+int TraceRing::getCapacity() const {
+    return (int) mask + 1;
+}
+
+int TraceRing::copy(Record *out) const {
+    lock.lock();
+    uint64_t first = next > mask ? next - mask - 1 : 0;
+    for (uint64_t i = first; i < next; ++i)
+        *out++ = records[i & mask];
+    int count = (int) (next - first);
+    lock.unlock();
+    return count;
+}
+
+/*
+ * converts a stamp to microseconds since the first ring was created
+ */
+static double stampUsecs(uint64_t stamp, uint64_t base_stamp, double nsecs_per_stamp) {
+    return (double) (int64_t) (stamp - base_stamp) * nsecs_per_stamp / 1000;
+}
+
+bool TraceRing::writeChromeJson(FILE *out, const Record *records, const int *counts, int rings, int capacity) {
+    // the rate of the stamps, measured over the whole trace
+    uint64_t end_stamp = stamp();
+    long long end_nsecs = clockNsecs(CLOCK_MONOTONIC);
+    double nsecs_per_stamp = end_stamp > base_stamp ? (double) (end_nsecs - base_nsecs) / (end_stamp - base_stamp) : 1;
+    int pid = getpid();
+
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    const char *separator = "\n";
+    for (int ring = 0; ring < rings; ++ring) {
+        fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                     "\"args\": {\"name\": \"worker %d\"}}", separator, pid, ring, ring);
+        separator = ",\n";
+
+        // backwards, so the slice of a thread ends where the next slice (or idle stretch) of the worker starts
+        const Record *ring_records = records + (long) ring * capacity;
+        uint64_t slice_end = end_stamp;
+        for (int i = counts[ring] - 1; i >= 0; --i) {
+            const Record &record = ring_records[i];
+            double ts = stampUsecs(record.stamp, base_stamp, nsecs_per_stamp);
+            switch (record.event) {
+                case TRACE_RUN:
+                    fprintf(out, ",\n{\"name\": \"uthread %d\", \"cat\": \"run\", \"ph\": \"X\", \"pid\": %d, "
+                                 "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"tid\": %d, \"level\": %d}}",
+                            record.tid, pid, ring, ts, stampUsecs(slice_end, record.stamp, nsecs_per_stamp),
+                            record.tid, record.arg);
+                    slice_end = record.stamp;
+                    break;
+                case TRACE_IDLE:
+                    slice_end = record.stamp;
+                    break;
+                default:
+                    fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"sched\", \"ph\": \"i\", \"s\": \"t\", \"pid\": %d, "
+                                 "\"tid\": %d, \"ts\": %.3f, \"args\": {\"tid\": %d, \"arg\": %d}}",
+                            event_names[record.event], pid, ring, ts, record.tid, record.arg);
+            }
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return ferror(out) == 0;
+}
@@ -0,0 +1,95 @@
+#ifndef OS_EX2_TRACE_H
+#define OS_EX2_TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Clock.h"
+#include "SpinLock.h"
+
+/*
+ * what a trace record tells: a thread started running (arg is its MLFQ level), the worker went idle, a thread became
+ * READY, was blocked, unblocked, went to sleep, started to wait, or was terminated, or the timer went off (arg is the
+ * running thread's level)
+ */
+enum TraceEvent {TRACE_RUN, TRACE_IDLE, TRACE_READY, TRACE_BLOCK, TRACE_UNBLOCK, TRACE_SLEEP, TRACE_WAIT,
+                 TRACE_TERMINATE, TRACE_TICK};
+
+/*
+ * The scheduler trace of one worker: a ring of the latest records, written only by the worker's own kernel thread
+ * inside its critical sections, and copied out by any. A lock of the ring's own keeps a copy from reading a record
+ * while it is written, the scheduler's lock does not cover the scheduling paths that append.
+ *
+ * The records are allocated up front and appending is a few plain stores, so it is safe in the timer's signal
+ * handler. A record is stamped with the CPU's time stamp counter (the CLOCK_MONOTONIC time where there is none),
+ * which is converted to nanoseconds when the trace is written out.
+ */
+class TraceRing {
+public:
+    struct Record {
+        uint64_t stamp;
+        int32_t tid; // the thread the event is about, -1 for none
+        uint16_t event; // a TraceEvent
+        uint16_t arg;
+    };
+
+    /**
+     * @param capacity the number of records kept, rounded up to a power of 2
+     */
+    explicit TraceRing(int capacity);
+    ~TraceRing();
+
+    int getCapacity() const;
+
+    void append(TraceEvent event, int tid, int arg);
+
+    /**
+     * copies the records in the ring to out, oldest first
+     * @param out room for getCapacity() records
+     * @return the number of records copied
+     */
+    int copy(Record *out) const;
+
+    /**
+     * writes the records of the given rings as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev): a track
+     * per ring, a slice per stretch a thread ran, and an instant event for every other record.
+     * @param records the records of ring i start at records + i * capacity, oldest first
+     * @param counts the number of records of each ring
+     * @return false if writing failed
+     */
+    static bool writeChromeJson(FILE *out, const Record *records, const int *counts, int rings, int capacity);
+
+private:
+    Record *records;
+    const uint32_t mask;
+    uint64_t next; // the number of records appended so far
+    mutable SpinLock lock;
+
+    static uint64_t base_stamp; // the stamp and the CLOCK_MONOTONIC time of the first ring's creation
+    static long long base_nsecs;
+
+    static uint64_t stamp();
+};
+
+inline uint64_t TraceRing::stamp() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return clockNsecs(CLOCK_MONOTONIC);
+#endif
+}
+
+inline void TraceRing::append(TraceEvent event, int tid, int arg) {
+    lock.lock();
+    Record *record = &records[next & mask];
+    record->stamp = stamp();
+    record->tid = tid;
+    record->event = (uint16_t) event;
+    record->arg = (uint16_t) arg;
+    next++;
+    lock.unlock();
+}
+
+#endif //OS_EX2_TRACE_H
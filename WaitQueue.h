@@ -0,0 +1,117 @@
+#ifndef OS_EX2_WAITQUEUE_H
+#define OS_EX2_WAITQUEUE_H
+
+#include "uthreads.h"
+
+class Thread;
+
+/*
+ * A thread waiting in a WaitQueue. It lives on the stack of the waiting thread, which stays inside the
+ * waiting library call for as long as the waiter is queued.
+ */
+struct Waiter {
+    Thread *thread;
+    Waiter *prev;
+    Waiter *next;
+    uthread_wait_queue *queue; // the queue the waiter is in, nullptr if none
+    void *object; // what the thread waits for, if the queue's owner needs to know (a condition variable's mutex)
+    Waiter *sibling; // a ring of the waiters of a thread waiting in several queues at once, itself otherwise
+    void (*expire)(Waiter *waiter); // ends the wait when its timeout passes, nullptr to just wake the thread
+    bool timed_out; // the wait ended because its timeout passed
+
+    explicit Waiter(Thread *thread, void *object = nullptr) : thread(thread), prev(nullptr), next(nullptr),
+            queue(nullptr), object(object), sibling(this), expire(nullptr), timed_out(false) {}
+};
+
+/*
+ * The FIFO of threads waiting for a mutex, a condition variable or a semaphore.
+ *
+ * The queue itself (its head and tail) is stored in the synchronization object the user allocated, so
+ * a WaitQueue is only a view over it, and it is intrusive: nothing is allocated, and a
+ * waiter is unlinked in O(1) (when its thread is terminated while waiting). Only used under the
+ * scheduler's lock.
+ */
+class WaitQueue {
+public:
+    explicit WaitQueue(uthread_wait_queue *queue);
+
+    bool empty() const;
+
+    /**
+     * adds the waiter to the tail of the queue
+     */
+    void pushBack(Waiter *waiter);
+
+    /**
+     * removes and returns the waiter at the head of the queue, nullptr if the queue is empty
+     */
+    Waiter *popFront();
+
+    /**
+     * unlinks the waiter from the queue it is in, if it is in one
+     */
+    static void remove(Waiter *waiter);
+
+    /**
+     * unlinks the waiter and its siblings from the queues they are in
+     */
+    static void removeAll(Waiter *waiter);
+
+private:
+    uthread_wait_queue *queue;
+};
+
+inline WaitQueue::WaitQueue(uthread_wait_queue *queue) : queue(queue) {}
+
+inline bool WaitQueue::empty() const {
+    return queue->head == nullptr;
+}
+
+inline void WaitQueue::pushBack(Waiter *waiter) {
+    auto *tail = (Waiter *) queue->tail;
+    waiter->next = nullptr;
+    waiter->prev = tail;
+    waiter->queue = queue;
+    if (tail != nullptr)
+        tail->next = waiter;
+    else
+        queue->head = waiter;
+    queue->tail = waiter;
+}
+
+inline Waiter *WaitQueue::popFront() {
+    auto *waiter = (Waiter *) queue->head;
+    if (waiter != nullptr)
+        remove(waiter);
+    return waiter;
+}
+
+inline void WaitQueue::remove(Waiter *waiter) {
+    uthread_wait_queue *queue = waiter->queue;
+    if (queue == nullptr)
+        return;
+
+    if (waiter->prev != nullptr)
+        waiter->prev->next = waiter->next;
+    else
+        queue->head = waiter->next;
+
+    if (waiter->next != nullptr)
+        waiter->next->prev = waiter->prev;
+    else
+        queue->tail = waiter->prev;
+
+    waiter->prev = nullptr;
+    waiter->next = nullptr;
+    waiter->queue = nullptr;
+}
+
+inline void WaitQueue::removeAll(Waiter *waiter) {
+    Waiter *sibling = waiter;
+    do {
+        remove(sibling);
+        sibling = sibling->sibling;
+    } while (sibling != waiter);
+}
+
+#endif //OS_EX2_WAITQUEUE_H
@@ -0,0 +1,106 @@
+#ifndef OS_EX2_WAKEINBOX_H
+#define OS_EX2_WAKEINBOX_H
+
+#include <atomic>
+
+#define INBOX_END (-1) /* the end of the list of posted IDs */
+
+/*
+ * The resumes posted by kernel threads that cannot enter the scheduler (helper pthreads, signal handlers), until the
+ * scheduler carries them out.
+ *
+ * The inbox is a lock-free stack of thread IDs linked through a slot per ID, so posting allocates nothing, takes no
+ * lock and is async-signal-safe. Every post carries the generation of the ID it was meant for (see ThreadTable), so
+ * the scheduler can drop a post whose ID was reused since. An ID is in the inbox at most once: posting it again
+ * before the scheduler took it only brings its generation up to date, and a post for an older generation has no
+ * effect. The scheduler only ever takes the whole stack at once, so there is no ABA problem.
+ */
+class WakeInbox {
+public:
+    /**
+     * @param slots the number of thread IDs, the IDs posted are 0 to slots - 1
+     */
+    explicit WakeInbox(int slots);
+    ~WakeInbox();
+
+    /**
+     * adds the ID to the inbox, for the given generation of it, unless it is already in it. any kernel thread may
+     * call it, at any time.
+     * @return false if the ID was already in the inbox
+     */
+    bool post(int tid, unsigned generation);
+
+    /**
+     * true if IDs were posted since the last take. needs no lock.
+     */
+    bool hasPosts() const;
+
+    /**
+     * empties the inbox, and returns the first of the IDs it held, in the order they were posted (INBOX_END if it
+     * was empty). release returns the ID after the given one, sets generation to the latest generation the given
+     * one was posted for, and lets it be posted again. only one kernel thread at a time may take and release.
+     */
+    int take();
+    int release(int tid, unsigned *generation);
+
+private:
+    struct Slot {
+        std::atomic<unsigned> posted; // 0 if the ID is not in the inbox, 1 + the generation it was posted for if it is
+        int next;
+    };
+
+    Slot *slots;
+    std::atomic<int> top;
+};
+
+inline WakeInbox::WakeInbox(int slots) : slots(new Slot[slots]()), top(INBOX_END) {}
+
+inline WakeInbox::~WakeInbox() {
+    delete[] slots;
+}
+
+inline bool WakeInbox::post(int tid, unsigned generation) {
+    unsigned mark = generation + 1;
+    unsigned posted = slots[tid].posted.load(std::memory_order_relaxed);
+    do {
+        // compared as serial numbers, generations wrap around
+        if (posted != 0 && (int) (posted - mark) >= 0)
+            return false;
+    } while (!slots[tid].posted.compare_exchange_weak(posted, mark, std::memory_order_acquire,
+                                                      std::memory_order_relaxed));
+    if (posted != 0)
+        return false; // an older post is still in the inbox, and now stands for this generation
+
+    // the slot is ours until it is released, only its link is written before the push publishes it
+    int next = top.load(std::memory_order_relaxed);
+    do {
+        slots[tid].next = next;
+    } while (!top.compare_exchange_weak(next, tid, std::memory_order_release, std::memory_order_relaxed));
+    return true;
+}
+
+inline bool WakeInbox::hasPosts() const {
+    return top.load(std::memory_order_relaxed) != INBOX_END;
+}
+
+inline int WakeInbox::take() {
+    int tid = top.exchange(INBOX_END, std::memory_order_acquire);
+
+    // the stack holds the latest post first, reverse it
+    int first = INBOX_END;
+    while (tid != INBOX_END) {
+        int next = slots[tid].next;
+        slots[tid].next = first;
+        first = tid;
+        tid = next;
+    }
+    return first;
+}
+
+inline int WakeInbox::release(int tid, unsigned *generation) {
+    int next = slots[tid].next;
+    *generation = slots[tid].posted.exchange(0, std::memory_order_acq_rel) - 1;
+    return next;
+}
+
+#endif //OS_EX2_WAKEINBOX_H
@@ -0,0 +1,309 @@
+#include "Worker.h"
+#include "Scheduler.h"
+#include <iostream>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/*
+ * The per kernel thread state is reached through initial-exec TLS, so each access is a single
+ * %fs-relative instruction, and only through the non-inlined accessors below: the compiler may
+ * otherwise keep a TLS address in a register across a context switch, after which the uthread
+ * could be running on a different kernel thread.
+ */
+#define WORKER_TLS __thread __attribute__((tls_model("initial-exec")))
+
+static WORKER_TLS Worker *current_worker = nullptr;
+static WORKER_TLS Thread *current_thread = nullptr;
+static WORKER_TLS volatile sig_atomic_t preemption_pending = 0;
+
+Worker::Worker(int index, Scheduler *scheduler, int levels) : index(index), scheduler(scheduler),
+        running(nullptr), idle(nullptr), terminated(nullptr), levels(levels), ready(new RunQueue[levels]),
+        next(nullptr), boost(0), switched_from(nullptr), switched_run_next(false), unpolled(0), stats(), cpu_mark(0),
+        kernel_thread(pthread_self()), thread_timer(false), timer(), timer_mode(TIMER_OFF), tick_usecs(0), switches(0),
+        tick_switches(0), ticks(0), trace(nullptr) {}
+
+Worker::~Worker() {
+    if (thread_timer)
+        timer_delete(timer);
+    delete idle;
+    delete trace;
+    for (Thread *thread = takeTerminated(); thread != nullptr;) {
+        Thread *next = thread->getNextTerminated();
+        delete thread;
+        thread = next;
+    }
+    delete[] ready;
+}
+
+int Worker::getIndex() const {
+    return index;
+}
+
+Scheduler *Worker::getScheduler() const {
+    return scheduler;
+}
+
+__attribute__((noinline)) Worker *Worker::current() {
+    return current_worker;
+}
+
+__attribute__((noinline)) Thread *Worker::currentThread() {
+    return current_thread;
+}
+
+__attribute__((noinline)) bool Worker::isPreemptionPending() {
+    return preemption_pending != 0;
+}
+
+__attribute__((noinline)) void Worker::setPreemptionPending(bool pending) {
+    preemption_pending = pending;
+}
+
+void Worker::attach(Thread *thread) {
+    current_worker = this;
+    cpu_mark = clockNsecs(CLOCK_THREAD_CPUTIME_ID);
+    setRunning(thread);
+}
+
+void Worker::setRunning(Thread *thread) {
+    running = thread;
+    current_thread = thread;
+}
+
+Thread *Worker::getRunning() const {
+    return running;
+}
+
+void Worker::pushReady(Thread *thread) {
+    ready[thread->getLevel()].push(thread);
+}
+
+void Worker::pushNext(Thread *thread) {
+    Thread *previous = next.exchange(thread);
+    if (previous != nullptr)
+        pushReady(previous);
+}
+
+Thread *Worker::popReady() {
+    if (next.load(std::memory_order_relaxed) != nullptr) {
+        Thread *thread = next.exchange(nullptr);
+        if (thread != nullptr) // or another worker took it first
+            return thread;
+    }
+    for (int level = 0; level < levels; ++level) {
+        Thread *thread = ready[level].pop();
+        if (thread != nullptr)
+            return thread;
+    }
+    return nullptr;
+}
+
+int Worker::readyCount() const {
+    int count = next.load(std::memory_order_relaxed) != nullptr ? 1 : 0;
+    for (int level = 0; level < levels; ++level)
+        count += ready[level].size();
+    return count;
+}
+
+bool Worker::hasReadyUpTo(int level) const {
+    if (next.load(std::memory_order_relaxed) != nullptr)
+        return true;
+    for (int i = 0; i <= level && i < levels; ++i) {
+        if (!ready[i].empty())
+            return true;
+    }
+    return false;
+}
+
+bool Worker::stealFrom(Worker *victim) {
+    for (int level = 0; level < levels; ++level) {
+        if (victim->ready[level].stealInto(&ready[level]) > 0)
+            return true;
+    }
+    Thread *thread = victim->next.load(std::memory_order_relaxed);
+    if (thread == nullptr || !victim->next.compare_exchange_strong(thread, nullptr))
+        return false;
+    pushReady(thread);
+    return true;
+}
+
+void Worker::boostReady(int new_boost) {
+    if (boost == new_boost)
+        return;
+    boost = new_boost;
+    for (int level = 1; level < levels; ++level) {
+        while (Thread *thread = ready[level].pop())
+            ready[0].push(thread);
+    }
+}
+
+void Worker::setSwitchedFrom(Thread *thread, bool run_next) {
+    switched_from = thread;
+    switched_run_next = run_next;
+}
+
+Thread *Worker::takeSwitchedFrom(bool *run_next) {
+    Thread *thread = switched_from;
+    switched_from = nullptr;
+    *run_next = switched_run_next;
+    return thread;
+}
+
+int Worker::countUnpolled() {
+    return ++unpolled;
+}
+
+void Worker::clearUnpolled() {
+    unpolled = 0;
+}
+
+void Worker::addSchedulerTime(long long nsecs) {
+    __atomic_store_n(&stats.scheduler_nsecs, stats.scheduler_nsecs + nsecs, __ATOMIC_RELAXED);
+}
+
+void Worker::countThreadSwitch(bool involuntary) {
+    __atomic_store_n(&stats.switches, stats.switches + 1, __ATOMIC_RELAXED);
+    if (involuntary)
+        __atomic_store_n(&stats.involuntary_switches, stats.involuntary_switches + 1, __ATOMIC_RELAXED);
+}
+
+void Worker::addStats(uthread_global_stats *out) const {
+    out->switches += __atomic_load_n(&stats.switches, __ATOMIC_RELAXED);
+    out->involuntary_switches += __atomic_load_n(&stats.involuntary_switches, __ATOMIC_RELAXED);
+    out->scheduler_nsecs += __atomic_load_n(&stats.scheduler_nsecs, __ATOMIC_RELAXED);
+}
+
+long long Worker::getCpuMark() const {
+    return cpu_mark;
+}
+
+void Worker::setCpuMark(long long mark) {
+    cpu_mark = mark;
+}
+
+Thread *Worker::getIdleThread() const {
+    return idle;
+}
+
+void Worker::setIdleThread(Thread *thread) {
+    idle = thread;
+}
+
+void Worker::pushTerminated(Thread *thread) {
+    thread->setNextTerminated(terminated);
+    terminated = thread;
+}
+
+Thread *Worker::takeTerminated() {
+    Thread *head = terminated;
+    terminated = nullptr;
+    return head;
+}
+
+bool Worker::hasTerminated() const {
+    return terminated != nullptr;
+}
+
+TraceRing *Worker::getTrace() const {
+    return trace;
+}
+
+void Worker::setTrace(TraceRing *new_trace) {
+    trace = new_trace;
+}
+
+bool Worker::useThreadTimer() {
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGVTALRM;
+    event._sigev_un._tid = (pid_t) syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer))
+        return false;
+    thread_timer = true;
+    return true;
+}
+
+bool Worker::armTimer(const struct itimerval &time) {
+    bool periodic = time.it_interval.tv_sec != 0 || time.it_interval.tv_usec != 0;
+    bool expires = time.it_value.tv_sec != 0 || time.it_value.tv_usec != 0;
+    timer_mode = periodic && expires ? TIMER_PERIODIC : expires ? TIMER_ONCE : TIMER_OFF;
+    if (!thread_timer)
+        return setitimer(ITIMER_VIRTUAL, &time, nullptr) == 0;
+
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = time.it_value.tv_sec;
+    spec.it_value.tv_nsec = time.it_value.tv_usec * 1000;
+    spec.it_interval.tv_sec = time.it_interval.tv_sec;
+    spec.it_interval.tv_nsec = time.it_interval.tv_usec * 1000;
+    return timer_settime(timer, 0, &spec, nullptr) == 0;
+}
+
+void Worker::disarmTimer() {
+    if (timer_mode == TIMER_OFF)
+        return;
+    struct itimerval stop = {};
+    armTimer(stop);
+}
+
+/*
+ * the itimerval of the given time, in microseconds
+ */
+static struct timeval toTimeval(long long usecs) {
+    struct timeval time = {};
+    time.tv_sec = usecs / 1000000;
+    time.tv_usec = usecs % 1000000;
+    return time;
+}
+
+bool Worker::startTicking(long long usecs) {
+    if (timer_mode == TIMER_PERIODIC && tick_usecs == usecs)
+        return true;
+    struct itimerval time = {};
+    time.it_value = time.it_interval = toTimeval(usecs);
+    tick_usecs = usecs;
+    return armTimer(time);
+}
+
+bool Worker::armOnce(long long usecs) {
+    struct itimerval time = {};
+    time.it_value = toTimeval(usecs);
+    return armTimer(time);
+}
+
+TimerMode Worker::getTimerMode() const {
+    return timer_mode;
+}
+
+void Worker::countSwitch() {
+    switches++;
+}
+
+int Worker::countTick() {
+    if (tick_switches != switches) {
+        tick_switches = switches;
+        ticks = 0;
+        return 0;
+    }
+    return ++ticks;
+}
+
+void Worker::interrupt() const {
+    pthread_kill(kernel_thread, SIGVTALRM);
+}
+
+bool Worker::start() {
+    return pthread_create(&kernel_thread, nullptr, Worker::run, this) == 0;
+}
+
+void *Worker::run(void *arg) {
+    auto *worker = (Worker *) arg;
+    // the idle thread of a started worker has no stack of its own, it is this kernel thread's
+    worker->attach(worker->idle);
+    if (!worker->useThreadTimer()) {
+        std::cerr << "system error: failed to create a worker timer\n";
+        exit(1);
+    }
+
+    worker->scheduler->idleLoop(worker);
+    return nullptr;
+}
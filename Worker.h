@@ -0,0 +1,232 @@
+#ifndef OS_EX2_WORKER_H
+#define OS_EX2_WORKER_H
+
+#include <atomic>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include "Thread.h"
+#include "RunQueue.h"
+#include "Trace.h"
+
+class Scheduler;
+
+/*
+ * what the timer of a worker is set to do
+ */
+enum TimerMode {TIMER_OFF, TIMER_ONCE, TIMER_PERIODIC};
+
+/*
+ * A kernel thread that runs uthreads.
+ *
+ * Everything the Scheduler keeps per kernel thread lives here: the thread running on it, its own
+ * ready queue, its preemption timer, the threads whose deletion is waiting for the worker to switch
+ * off their stack, and an idle thread that runs whenever the worker has nothing else to do.
+ * Without M:N scheduling there is a single Worker, the kernel thread that called uthread_init.
+ *
+ * A uthread may move to another worker whenever it is switched out, so code running in a uthread
+ * must fetch the current worker again after anything that may switch (Worker::current is never
+ * cached by the compiler).
+ */
+class Worker {
+public:
+    /**
+     * @param index the worker's number, 0 is the kernel thread that called uthread_init
+     * @param scheduler the scheduler the worker runs threads for
+     * @param levels the number of priority levels of the ready queue (1 for plain round robin)
+     */
+    Worker(int index, Scheduler *scheduler, int levels);
+    ~Worker();
+
+    int getIndex() const;
+
+    Scheduler *getScheduler() const;
+
+    /**
+     * the worker of the calling kernel thread, nullptr for kernel threads that are not workers
+     */
+    static Worker *current();
+
+    /**
+     * the thread running on the calling kernel thread, nullptr for kernel threads that are not workers.
+     * a single load, so the result is right even if the caller is moved to another worker right after.
+     */
+    static Thread *currentThread();
+
+    /**
+     * makes the calling kernel thread this worker, running the given thread
+     */
+    void attach(Thread *thread);
+
+    /**
+     * sets the thread running on this worker. must be called from the worker's own kernel thread.
+     */
+    void setRunning(Thread *thread);
+    Thread *getRunning() const;
+
+    /**
+     * a preemption that arrived while the running thread was in a critical section, for the calling
+     * kernel thread's worker
+     */
+    static bool isPreemptionPending();
+    static void setPreemptionPending(bool pending);
+
+    /**
+     * the ready queue of the worker: a RunQueue per priority level, the thread's level picks the queue, and a slot for
+     * the thread to run next, ahead of the queues. only the worker's own kernel thread pushes, any worker takes, and
+     * none of it needs the scheduler's lock.
+     * pushReady adds the thread to the tail of its level, pushNext puts it in the slot (the thread that was there
+     * goes to the tail of its level). popReady takes the thread in the slot, or else the head of the highest
+     * non-empty level. what is taken may be a stale entry (see Thread::takeFromQueue).
+     * readyCount and hasReadyUpTo count the stale entries too.
+     */
+    void pushReady(Thread *thread);
+    void pushNext(Thread *thread);
+    Thread *popReady();
+    int readyCount() const;
+
+    /**
+     * true if a thread is ready at the given level or a higher one (a lower number), or in the slot
+     */
+    bool hasReadyUpTo(int level) const;
+
+    /**
+     * moves the older half of the highest non-empty level of the given worker to the same level of this one, or,
+     * if all its levels are empty, the thread in its slot. must be called from this worker's kernel thread.
+     * @return true if anything was moved
+     */
+    bool stealFrom(Worker *victim);
+
+    /**
+     * moves every ready thread to the end of the highest level, in level order, unless the worker already did for
+     * the given boost. must be called from the worker's own kernel thread, the threads' levels are reset when they
+     * run (see Scheduler::currentLevel).
+     * @param boost the number of the latest boost
+     */
+    void boostReady(int boost);
+
+    /**
+     * the thread the worker switched away from, until the switch is over (see Scheduler::finishSwitch), and
+     * whether it is to go in the slot of the thread to run next rather than at the tail of its level
+     */
+    void setSwitchedFrom(Thread *thread, bool run_next);
+    Thread *takeSwitchedFrom(bool *run_next);
+
+    /**
+     * counts a scheduling decision since the worker last looked for ready fds (see POLL_INTERVAL_SWITCHES), and
+     * returns the count. clearUnpolled starts the count over.
+     */
+    int countUnpolled();
+    void clearUnpolled();
+
+    /**
+     * the worker's share of the library statistics (see uthread_get_global_stats): addSchedulerTime adds CPU time
+     * spent switching, countThreadSwitch counts a switch from one thread to another. they are only called from the
+     * worker's own kernel thread, addStats adds the worker's share to stats from any.
+     */
+    void addSchedulerTime(long long nsecs);
+    void countThreadSwitch(bool involuntary);
+    void addStats(uthread_global_stats *stats) const;
+
+    /**
+     * the reading of the kernel thread's CPU clock when its CPU time was last charged to a thread or to
+     * the scheduler (see uthread_get_stats). read first when a kernel thread becomes the worker.
+     */
+    long long getCpuMark() const;
+    void setCpuMark(long long mark);
+
+    Thread *getIdleThread() const;
+    void setIdleThread(Thread *thread);
+
+    /**
+     * the reaper list: the threads that terminated themselves on this worker, and are deleted once the worker is off
+     * their stacks. pushTerminated adds a thread (linked through the thread, so it never allocates), takeTerminated
+     * empties the list and returns its head, the rest follow through Thread::getNextTerminated.
+     */
+    void pushTerminated(Thread *thread);
+    Thread *takeTerminated();
+    bool hasTerminated() const;
+
+    /**
+     * use a per-kernel-thread CPU time timer instead of the process wide ITIMER_VIRTUAL.
+     * must be called from the worker's own kernel thread.
+     * @return false if the timer could not be created
+     */
+    bool useThreadTimer();
+
+    /**
+     * (re)starts the worker's timer, to expire once after the given time (or periodically, if the time has
+     * an interval)
+     * @return false if the timer could not be set
+     */
+    bool armTimer(const struct itimerval &time);
+
+    /**
+     * stops the worker's timer
+     */
+    void disarmTimer();
+
+    /**
+     * for tickless scheduling: startTicking makes the timer expire every period, armOnce makes it expire once
+     * after the given time. startTicking and disarmTimer make no system call if the timer already does that.
+     * @return false if the timer could not be set
+     */
+    bool startTicking(long long usecs);
+    bool armOnce(long long usecs);
+    TimerMode getTimerMode() const;
+
+    /**
+     * the switch generation of tickless scheduling: countSwitch is called whenever a thread starts a quantum on
+     * the worker, and countTick whenever the periodic timer expires. countTick returns how many full periods the
+     * running thread has run, 0 for the part of a period since it started.
+     */
+    void countSwitch();
+    int countTick();
+
+    /**
+     * the worker's scheduler trace, nullptr if the scheduler is not traced. the worker deletes it.
+     */
+    TraceRing *getTrace() const;
+    void setTrace(TraceRing *trace);
+
+    /**
+     * makes the worker's kernel thread reschedule as soon as possible, by sending it SIGVTALRM
+     */
+    void interrupt() const;
+
+    /**
+     * starts a kernel thread for the worker, that runs the scheduler's idle loop
+     * @return false if the kernel thread could not be created
+     */
+    bool start();
+
+private:
+    const int index;
+    Scheduler *scheduler;
+    Thread *running;
+    Thread *idle;
+    Thread *terminated; // the head of the reaper list
+    const int levels;
+    RunQueue *ready; // one per level
+    std::atomic<Thread*> next; // the slot of the thread to run next
+    int boost; // the boost the ready queue was last moved up for
+    Thread *switched_from;
+    bool switched_run_next;
+    int unpolled;
+    uthread_global_stats stats; // only switches, involuntary_switches and scheduler_nsecs
+    long long cpu_mark;
+    pthread_t kernel_thread;
+    bool thread_timer;
+    timer_t timer;
+    TimerMode timer_mode;
+    long long tick_usecs; // the period of the timer, while it is TIMER_PERIODIC
+    unsigned switches;
+    unsigned tick_switches; // switches, as of the last countTick
+    int ticks;
+    TraceRing *trace;
+
+    static void *run(void *worker);
+};
+
+#endif //OS_EX2_WORKER_H
@@ -0,0 +1,100 @@
+/*
+ * Context switch micro benchmark.
+ *
+ * Ping-pongs between the main stack and a second stack, once through Context (the switch uthreads
+ * uses) and once through sigsetjmp / siglongjmp with the signal mask handling the library used to
+ * do on every switch, and prints the average cost of a single switch for each.
+ *
+ * usage: context_switch_bench [iterations]
+ */
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <signal.h>
+#include "Context.h"
+
+#define BENCH_STACK_SIZE 65536
+#define JB_SP 6
+#define JB_PC 7
+
+typedef unsigned long address_t;
+
+static long iterations = 1000000;
+static char other_stack[BENCH_STACK_SIZE] __attribute__((aligned(16)));
+
+static Context main_context, other_context;
+static sigjmp_buf main_env, other_env;
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void context_partner(void *) {
+    for (;;)
+        other_context.switchTo(main_context);
+}
+
+static double bench_context() {
+    other_context.init(other_stack, sizeof(other_stack), context_partner, nullptr);
+    double start = now_ns();
+    for (long i = 0; i < iterations; ++i)
+        main_context.switchTo(other_context);
+    return (now_ns() - start) / (2.0 * iterations);
+}
+
+/* the pointer mangling glibc applies to the registers saved in a jmp_buf */
+static address_t translate_address(address_t addr) {
+    address_t ret;
+    asm volatile("xor    %%fs:0x30,%0\n"
+                 "rol    $0x11,%0\n"
+            : "=g" (ret)
+            : "0" (addr));
+    return ret;
+}
+
+/* the old switch: save with the mask, unblock SIGVTALRM, jump (which restores the mask again) */
+static void sigjmp_switch(sigjmp_buf from, sigjmp_buf to) {
+    if (sigsetjmp(from, 1) == 0) {
+        sigset_t temp;
+        sigemptyset(&temp);
+        sigaddset(&temp, SIGVTALRM);
+        sigprocmask(SIG_UNBLOCK, &temp, nullptr);
+        siglongjmp(to, 1);
+    }
+}
+
+static void sigjmp_partner() {
+    for (;;)
+        sigjmp_switch(other_env, main_env);
+}
+
+static double bench_sigjmp() {
+    sigsetjmp(other_env, 1);
+    address_t sp = (address_t) other_stack + BENCH_STACK_SIZE - sizeof(address_t);
+    (other_env->__jmpbuf)[JB_SP] = translate_address(sp);
+    (other_env->__jmpbuf)[JB_PC] = translate_address((address_t) sigjmp_partner);
+    sigemptyset(&other_env->__saved_mask);
+
+    double start = now_ns();
+    for (long i = 0; i < iterations; ++i)
+        sigjmp_switch(main_env, other_env);
+    return (now_ns() - start) / (2.0 * iterations);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1)
+        iterations = strtol(argv[1], nullptr, 10);
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    double context_ns = bench_context();
+    double sigjmp_ns = bench_sigjmp();
+    printf("context switch (uthread_context_switch): %8.1f ns\n", context_ns);
+    printf("context switch (sigsetjmp/siglongjmp):   %8.1f ns\n", sigjmp_ns);
+    return 0;
+}
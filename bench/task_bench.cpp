@@ -0,0 +1,227 @@
+/*
+ * Task benchmark suite (uthread_task.h, C++20).
+ *
+ * Measures the cost of stackless tasks, next to the threads they stand in for:
+ *   task_spawn_run - uthread::spawn of a task that runs and returns (ns per task)
+ *   task_await     - co_await of a task that returns at once, from another task (ns per await)
+ *   task_yield     - co_await uthread::yield(), every task yielding in turn (ns per switch)
+ *   task_parked    - the memory of a task suspended in uthread::sleep_for, its frame and timer (bytes per task, from
+ *                    the growth of the resident set)
+ * Results are printed as JSON lines, like uthread_bench:
+ *   {"bench": "task_yield", "impl": "uthread-tasks", "tasks": 1000, "ops": 1000000, "value": 48.2, "unit": "ns/op"}
+ *
+ * usage: task_bench [-q] [-t tasks,...] [bench ...]
+ *   -q  quick run, with a tenth of the operations
+ *   -t  the task counts to measure, default 1000,100000,1000000
+ *   bench  the benchmarks to run, default all of them
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "uthread_task.h"
+#include "Clock.h"
+
+#define QUANTUM_USECS 1000
+#define PARK_USECS 200000
+
+static long scale = 1; // every operation count is divided by it
+static int bench_tasks;
+
+static long counter;
+
+static void report(const char *bench, long ops, double value, const char *unit) {
+    printf("{\"bench\": \"%s\", \"impl\": \"uthread-tasks\", \"tasks\": %d, \"ops\": %ld, \"value\": %.1f, "
+           "\"unit\": \"%s\"}\n", bench, bench_tasks, ops, value, unit);
+    fflush(stdout);
+}
+
+static long ops(long count) {
+    return count / scale > 0 ? count / scale : 1;
+}
+
+static void init_library() {
+    uthread_config config = {};
+    config.quantum_usecs = QUANTUM_USECS;
+    if (uthread_init_config(&config) != 0 || uthread::start_tasks() != 0)
+        exit(1);
+}
+
+static long residentBytes() {
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return 0;
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static uthread::task<void> count_and_return() {
+    counter++;
+    co_return;
+}
+
+static void bench_task_spawn_run() {
+    init_library();
+    long rounds = ops(1000000) / bench_tasks > 0 ? ops(1000000) / bench_tasks : 1;
+
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long round = 0; round < rounds; ++round) {
+        for (int i = 0; i < bench_tasks; ++i)
+            uthread::spawn(count_and_return());
+        while (counter < (round + 1) * bench_tasks)
+            uthread_yield();
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long tasks = rounds * bench_tasks;
+    report("task_spawn_run", tasks, (double) elapsed / tasks, "ns/op");
+}
+
+static uthread::task<int> identity(int value) {
+    co_return value;
+}
+
+static uthread::task<long> await_many(long count) {
+    long sum = 0;
+    for (long i = 0; i < count; ++i)
+        sum += co_await identity((int) i);
+    co_return sum;
+}
+
+static void bench_task_await() {
+    init_library();
+    long count = ops(10000000);
+
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    uthread::block_on(await_many(count));
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    report("task_await", count, (double) elapsed / count, "ns/op");
+}
+
+static uthread::task<void> yield_times(long count) {
+    for (long i = 0; i < count; ++i)
+        co_await uthread::yield();
+    counter++;
+}
+
+static void bench_task_yield() {
+    init_library();
+    long rounds = ops(1000000) / bench_tasks > 0 ? ops(1000000) / bench_tasks : 1;
+
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (int i = 0; i < bench_tasks; ++i)
+        uthread::spawn(yield_times(rounds));
+    while (counter < bench_tasks)
+        uthread_yield();
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long switches = rounds * bench_tasks;
+    report("task_yield", switches, (double) elapsed / switches, "ns/op");
+}
+
+static uthread::task<void> park() {
+    co_await uthread::sleep_for(PARK_USECS);
+    counter++;
+}
+
+static void bench_task_parked() {
+    init_library();
+    uthread::block_on(park()); // the timer heap and the carriers are set up
+
+    long before = residentBytes();
+    for (int i = 0; i < bench_tasks; ++i)
+        uthread::spawn(park());
+    while (counter < 2) // all of them run up to their sleep before the one spawned first wakes up
+        uthread_yield();
+    long after = residentBytes();
+    while (counter < bench_tasks + 1)
+        uthread_yield();
+
+    report("task_parked", bench_tasks, (double) (after - before) / bench_tasks, "bytes");
+}
+
+struct Benchmark {
+    const char *name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+        {"task_spawn_run", bench_task_spawn_run},
+        {"task_await", bench_task_await},
+        {"task_yield", bench_task_yield},
+        {"task_parked", bench_task_parked},
+};
+
+static bool selected(const char *name, int argc, char *argv[], int first) {
+    if (first == argc)
+        return true;
+    for (int i = first; i < argc; ++i) {
+        if (strcmp(argv[i], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * the library can be initialized only once, so every measurement runs in a child process of its own
+ */
+static void run_isolated(const Benchmark &benchmark) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (child == 0) {
+        benchmark.run();
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("{\"bench\": \"%s\", \"tasks\": %d, \"error\": \"exit status %d\"}\n", benchmark.name,
+               bench_tasks, status);
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<int> task_counts = {1000, 100000, 1000000};
+    int opt;
+    while ((opt = getopt(argc, argv, "qt:")) != -1) {
+        if (opt == 'q') {
+            scale = 10;
+        } else if (opt == 't') {
+            task_counts.clear();
+            for (char *count = strtok(optarg, ","); count != nullptr; count = strtok(nullptr, ","))
+                task_counts.push_back(atoi(count));
+        } else {
+            fprintf(stderr, "usage: %s [-q] [-t tasks,...] [bench ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (int count : task_counts) {
+        if (count <= 0) {
+            fprintf(stderr, "task counts must be positive\n");
+            return 1;
+        }
+    }
+
+    for (const Benchmark &benchmark : benchmarks) {
+        if (!selected(benchmark.name, argc, argv, optind))
+            continue;
+        for (int count : task_counts) {
+            bench_tasks = count;
+            run_isolated(benchmark);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,397 @@
+/*
+ * Behaviour tests of the tasks of uthread_task.h:
+ *   await      - co_await returns the awaited task's result, and block_on the result of the task it runs
+ *   exception  - an exception that leaves a task is rethrown by the co_await of it, and by block_on
+ *   task_mutex - a task_mutex keeps tasks that yield while they hold it out, and hands it over in FIFO order
+ *   channels   - chan_send and chan_recv between tasks and threads, with tasks parked on the channel while they
+ *                wait, and closing a channel the tasks wait on
+ *   fairness   - tasks and plain threads share the CPU: yielding tasks go on next to a thread that spins, and a
+ *                thread goes on next to a task that spins without a co_await (its carrier is preempted)
+ *   stealing   - tasks spawned by a task go to its carrier's line, and the other carriers steal them from it
+ *   handoff    - threads hand elements over an unbuffered channel to tasks that each receive one and end right away,
+ *                so a task's frame is freed while its sender may still be inside uthread_chan_send
+ *
+ * The library can be initialized only once, so every test runs in a child process of its own. A test that fails
+ * prints the check that failed, and a test that hangs is killed after TEST_TIMEOUT_SECS seconds.
+ *
+ * usage: task_test [-w workers] [test ...]
+ *   -w  the number of kernel threads running the threads, default 1 (there is a carrier per worker)
+ *   test  the tests to run, default all of them
+ * exits with status 1 if a test failed.
+ */
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "uthread_task.h"
+#include "Clock.h"
+
+#define QUANTUM_USECS 1000
+#define MAX_THREADS 16 /* tasks need no threads of their own, the carriers, the timer thread and the tests' few */
+#define PARKED_TASKS 10000
+#define STOLEN_TASKS 64
+#define HANDOFF_SENDERS 4
+#define HANDOFF_ELEMS 20000 /* per sender */
+#define TEST_TIMEOUT_SECS 20
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            fflush(stdout); \
+            _exit(1); \
+        } \
+    } while (0)
+
+static int workers = 1;
+
+// the state the tasks of a test share (each test runs in a process of its own)
+static std::atomic<int> finished{0};
+static std::atomic<long> received{0};
+static uthread_chan_t *chan;
+
+static void init_library() {
+    uthread_config config = {};
+    config.quantum_usecs = QUANTUM_USECS;
+    config.workers = workers;
+    config.max_threads = MAX_THREADS;
+    if (uthread_init_config(&config) != 0 || uthread::start_tasks(workers) != 0)
+        exit(1);
+}
+
+static uthread::task<int> square(int n) {
+    co_await uthread::yield();
+    co_return n * n;
+}
+
+static uthread::task<int> sum_of_squares(int count) {
+    int sum = 0;
+    for (int i = 1; i <= count; ++i)
+        sum += co_await square(i);
+    co_return sum;
+}
+
+static void test_await() {
+    init_library();
+    CHECK(uthread::block_on(square(7)) == 49);
+    CHECK(uthread::block_on(sum_of_squares(10)) == 385);
+}
+
+static uthread::task<int> fail_after_sleep() {
+    co_await uthread::sleep_for(QUANTUM_USECS);
+    throw std::runtime_error("failed");
+    co_return 0;
+}
+
+static uthread::task<bool> catch_failure() {
+    try {
+        co_await fail_after_sleep();
+    }
+    catch (const std::runtime_error &) {
+        co_return true;
+    }
+    co_return false;
+}
+
+static void test_exception() {
+    init_library();
+    CHECK(uthread::block_on(catch_failure()));
+    bool caught = false;
+    try {
+        uthread::block_on(fail_after_sleep());
+    }
+    catch (const std::runtime_error &) {
+        caught = true;
+    }
+    CHECK(caught);
+}
+
+static uthread::task_mutex mutex;
+static long counter = 0;
+static int order[4];
+static std::atomic<int> queued{0};
+
+static uthread::task<void> increment(int times) {
+    for (int i = 0; i < times; ++i) {
+        co_await mutex.lock();
+        long seen = counter;
+        co_await uthread::yield();
+        counter = seen + 1;
+        mutex.unlock();
+    }
+    finished++;
+}
+
+static uthread::task<void> lock_in_turn(int turn) {
+    queued++;
+    co_await mutex.lock();
+    order[finished++] = turn;
+    mutex.unlock();
+}
+
+static void test_task_mutex() {
+    init_library();
+    for (int i = 0; i < 8; ++i)
+        uthread::spawn(increment(100));
+    while (finished < 8)
+        uthread_sleep_usec(100);
+    CHECK(counter == 800);
+
+    // the tasks queue up behind a lock taken by the main thread's task, one at a time
+    finished = 0;
+    CHECK(mutex.try_lock());
+    for (int i = 0; i < 4; ++i) {
+        uthread::spawn(lock_in_turn(i));
+        while (queued < i + 1)
+            uthread_sleep_usec(100);
+        uthread_sleep_usec(5 * QUANTUM_USECS);
+    }
+    mutex.unlock();
+    while (finished < 4)
+        uthread_sleep_usec(100);
+    CHECK(order[0] == 0 && order[1] == 1 && order[2] == 2 && order[3] == 3);
+}
+
+static uthread::task<void> send_range(int count) {
+    for (int i = 1; i <= count; ++i)
+        CHECK(co_await uthread::chan_send(chan, &i) == 0);
+}
+
+static uthread::task<long> recv_sum(int count) {
+    long sum = 0;
+    for (int i = 0; i < count; ++i) {
+        int elem;
+        CHECK(co_await uthread::chan_recv(chan, &elem) == 0);
+        sum += elem;
+    }
+    co_return sum;
+}
+
+static uthread::task<void> recv_until_closed() {
+    int elem = -1;
+    int result = co_await uthread::chan_recv(chan, &elem);
+    if (result == -1 && elem == 0)
+        finished++;
+}
+
+static uthread::task<int> send_one() {
+    int elem = 1;
+    co_return co_await uthread::chan_send(chan, &elem);
+}
+
+static void send_from_thread() {
+    for (int i = 1; i <= 100; ++i)
+        uthread_chan_send(chan, &i);
+    received++;
+    uthread_block(uthread_get_tid());
+}
+
+static void test_channels() {
+    init_library();
+    chan = uthread_chan_create(sizeof(int), 0);
+    CHECK(chan != nullptr);
+    uthread::spawn(send_range(1000));
+    CHECK(uthread::block_on(recv_sum(1000)) == 500500);
+
+    // a thread sending to tasks
+    CHECK(uthread_spawn(send_from_thread) > 0);
+    CHECK(uthread::block_on(recv_sum(100)) == 5050);
+
+    // far more tasks wait than there are threads, and closing the channel ends every wait
+    finished = 0;
+    for (int i = 0; i < PARKED_TASKS; ++i)
+        uthread::spawn(recv_until_closed());
+    uthread_sleep_usec(5 * QUANTUM_USECS);
+    CHECK(finished == 0);
+    CHECK(uthread_chan_close(chan) == 0);
+    while (finished < PARKED_TASKS)
+        uthread_sleep_usec(100);
+    CHECK(uthread::block_on(send_one()) == -1);
+}
+
+static std::atomic<long> spins{0};
+static std::atomic<bool> stop{false};
+static std::atomic<bool> stop_task{false};
+
+static void spin() {
+    while (!stop)
+        spins++;
+    finished++;
+}
+
+static void count_then_stop() {
+    for (int i = 0; i < 1000000; ++i)
+        spins++;
+    stop_task = true;
+}
+
+static uthread::task<void> yield_until_spun() {
+    // a starved thread would keep the task yielding until the test times out
+    while (spins == 0)
+        co_await uthread::yield();
+    finished++;
+}
+
+static uthread::task<void> spin_until_stopped() {
+    while (!stop_task) {}
+    finished++;
+    co_return;
+}
+
+static void test_fairness() {
+    init_library();
+    // a thread that never gives up the CPU, next to a task that does all the time
+    CHECK(uthread_spawn(spin) > 0);
+    uthread::spawn(yield_until_spun());
+    while (finished < 1)
+        uthread_sleep_usec(100);
+    stop = true;
+    while (finished < 2)
+        uthread_sleep_usec(100);
+
+    // a task that never gives up its carrier, next to a thread that ends it
+    uthread::spawn(spin_until_stopped());
+    uthread_sleep_usec(5 * QUANTUM_USECS);
+    CHECK(uthread_spawn(count_then_stop) > 0);
+    while (finished < 3)
+        uthread_sleep_usec(100);
+}
+
+static std::atomic<int> carriers_seen[MAX_THREADS];
+
+static uthread::task<void> count_carrier() {
+    // long enough for the other carriers to wake up and steal from the spawner's line
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    while (clockNsecs(CLOCK_MONOTONIC) - start < QUANTUM_USECS * 1000LL) {}
+    carriers_seen[uthread_get_tid()]++;
+    finished++;
+    co_return;
+}
+
+static uthread::task<void> spawn_counters(int count) {
+    for (int i = 0; i < count; ++i)
+        uthread::spawn(count_carrier());
+    co_return;
+}
+
+static void test_stealing() {
+    init_library();
+    uthread::block_on(spawn_counters(STOLEN_TASKS));
+    while (finished < STOLEN_TASKS)
+        uthread_sleep_usec(100);
+    int carriers = 0;
+    for (std::atomic<int> &seen : carriers_seen)
+        carriers += seen > 0;
+    CHECK(workers == 1 ? carriers == 1 : carriers > 1);
+}
+
+static uthread::task<void> recv_one() {
+    int elem;
+    CHECK(co_await uthread::chan_recv(chan, &elem) == 0);
+    received += elem;
+    finished++;
+}
+
+static void send_handoff() {
+    for (int i = 1; i <= HANDOFF_ELEMS; ++i)
+        CHECK(uthread_chan_send(chan, &i) == 0);
+    uthread_block(uthread_get_tid());
+}
+
+static void test_handoff() {
+    init_library();
+    chan = uthread_chan_create(sizeof(int), 0);
+    CHECK(chan != nullptr);
+    for (int i = 0; i < HANDOFF_SENDERS; ++i)
+        CHECK(uthread_spawn(send_handoff) > 0);
+    const int total = HANDOFF_SENDERS * HANDOFF_ELEMS;
+    for (int i = 0; i < total; ++i) {
+        // a few receivers at a time, so the senders mostly find one waiting on the channel
+        while (i - finished > 2 * HANDOFF_SENDERS)
+            uthread_yield();
+        uthread::spawn(recv_one());
+    }
+    while (finished < total)
+        uthread_sleep_usec(100);
+    CHECK(received == (long) HANDOFF_SENDERS * HANDOFF_ELEMS * (HANDOFF_ELEMS + 1) / 2);
+}
+
+struct Test {
+    const char *name;
+    void (*run)();
+};
+
+static const Test tests[] = {
+        {"await", test_await},
+        {"exception", test_exception},
+        {"task_mutex", test_task_mutex},
+        {"channels", test_channels},
+        {"fairness", test_fairness},
+        {"stealing", test_stealing},
+        {"handoff", test_handoff},
+};
+
+static bool selected(const char *name, int argc, char *argv[], int first) {
+    if (first == argc)
+        return true;
+    for (int i = first; i < argc; ++i) {
+        if (strcmp(argv[i], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * runs the test in a child process
+ * @return true if it passed
+ */
+static bool run_isolated(const Test &test) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (child == 0) {
+        alarm(TEST_TIMEOUT_SECS);
+        test.run();
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (passed)
+        printf("ok   %s\n", test.name);
+    else
+        printf("FAIL %s (exit status %d)\n", test.name, status);
+    fflush(stdout);
+    return passed;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "w:")) != -1) {
+        if (opt == 'w') {
+            workers = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-w workers] [test ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (workers <= 0) {
+        fprintf(stderr, "the number of workers must be positive\n");
+        return 1;
+    }
+
+    bool passed = true;
+    for (const Test &test : tests) {
+        if (selected(test.name, argc, argv, optind))
+            passed = run_isolated(test) && passed;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,559 @@
+/*
+ * Scheduler benchmark suite.
+ *
+ * Measures the cost of the library's basic operations, and how it scales with the number of threads:
+ *   yield_switch    - a switch made by uthread_yield, every thread yielding in turn (ns per switch)
+ *   timer_switch    - a switch forced by the quantum timer between spinning threads, from the last moment the
+ *                     preempted thread was seen running to the first moment the next one was (ns per switch)
+ *   tick_switch     - a switch at the end of a quantum in manual tick mode, every thread calling uthread_tick in
+ *                     turn with a quantum of one tick (ns per switch, the same schedule on every run)
+ *   block_resume    - uthread_resume of a blocked thread, a yield to it, and its uthread_block back to the main
+ *                     thread (ns per round trip, which makes two switches)
+ *   post_resume     - uthread_post_resume of a blocked thread from a pthread, until the thread signals the pthread
+ *                     back through a semaphore (ns per round trip, the worker idles and is woken in between)
+ *   chan_pipeline   - an element passed down a pipeline of threads linked by unbuffered channels, each receiving
+ *                     it and sending it on to the next (ns per hop)
+ *   spawn_terminate - uthread_spawn and uthread_terminate of a thread that never ran (ns per thread)
+ *   spawn_n         - the same, with every thread spawned by a single uthread_spawn_n (ns per thread)
+ *   spawn_run       - uthread_spawn of a thread that runs and returns (ns per thread)
+ *   spawn_join      - uthread_spawn_arg of a thread that runs and returns, and uthread_join of it (ns per thread)
+ *   sleep_late      - how many quantums after its deadline a uthread_sleep returns (mean and max)
+ * block_resume and spawn_run are also measured with pthreads, as a semaphore ping-pong and as pthread_create +
+ * pthread_join (the counterpart of spawn_join).
+ *
+ * The library can be initialized only once, so every measurement runs in a child process of its own.
+ * Results are printed as JSON lines, one object per measurement:
+ *   {"bench": "yield_switch", "impl": "uthreads", "threads": 1000, "ops": 999999, "value": 48.2, "unit": "ns/op"}
+ * a measurement that failed prints an "error" instead of a value.
+ *
+ * usage: uthread_bench [-q] [-T] [-t threads,...] [bench ...]
+ *   -q  quick run, with a tenth of the operations
+ *   -T  initialize the library in tickless mode, reported as impl "uthreads-tickless"
+ *   -t  the thread counts to measure, default 10,100,1000,10000,100000 (beyond GUARDED_MAX_THREADS, the library is
+ *       initialized with no_guard_pages)
+ *   bench  the benchmarks to run, default all of them
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "uthreads.h"
+#include "Clock.h"
+
+#define QUANTUM_USECS 1000
+#define SLEEP_QUANTUMS 3
+#define PTHREAD_MAX_THREADS 10000 /* beyond that, creating the pthreads runs into system limits */
+#define GUARDED_MAX_THREADS 30000 /* beyond that, guard pages run into vm.max_map_count */
+#define PTHREAD_STACK_SIZE 65536
+
+static long scale = 1; // every operation count is divided by it
+static int bench_threads;
+static bool tickless = false;
+static const char *uthreads_impl = "uthreads";
+
+// the state the threads of a measurement share (each measurement runs in a process of its own)
+static volatile long counter;
+static volatile int last_tid = -1;
+static volatile long long last_ns;
+static long long total_ns;
+static long long max_late;
+static long wanted;
+
+static void report(const char *bench, const char *impl, long ops, double value, const char *unit) {
+    printf("{\"bench\": \"%s\", \"impl\": \"%s\", \"threads\": %d, \"ops\": %ld, \"value\": %.1f, \"unit\": \"%s\"}\n",
+           bench, impl, bench_threads, ops, value, unit);
+    fflush(stdout);
+}
+
+static long ops(long count) {
+    return count / scale > 0 ? count / scale : 1;
+}
+
+static void init_library() {
+    uthread_config config = {};
+    config.quantum_usecs = QUANTUM_USECS;
+    config.max_threads = bench_threads + 1;
+    config.no_guard_pages = bench_threads > GUARDED_MAX_THREADS;
+    config.tickless = tickless;
+    if (uthread_init_config(&config) != 0)
+        exit(1);
+}
+
+static void spawn_all(thread_entry_point entry, std::vector<int> &ids) {
+    for (int i = 0; i < bench_threads; ++i) {
+        ids[i] = uthread_spawn(entry);
+        if (ids[i] < 0)
+            exit(1);
+    }
+}
+
+static void yield_forever() {
+    for (;;)
+        uthread_yield();
+}
+
+static void bench_yield_switch() {
+    init_library();
+    std::vector<int> ids(bench_threads);
+    spawn_all(yield_forever, ids);
+    uthread_yield(); // every thread runs once
+
+    long rounds = ops(1000000) / (bench_threads + 1) > 0 ? ops(1000000) / (bench_threads + 1) : 1;
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long i = 0; i < rounds; ++i)
+        uthread_yield();
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long switches = rounds * (bench_threads + 1);
+    report("yield_switch", uthreads_impl, switches, (double) elapsed / switches, "ns/op");
+}
+
+static void spin_and_watch() {
+    int self = uthread_get_tid();
+    for (;;) {
+        long long now = clockNsecs(CLOCK_MONOTONIC);
+        if (last_tid != self) {
+            if (last_tid >= 0) {
+                total_ns += now - last_ns;
+                counter++;
+            }
+            last_tid = self;
+            if (counter == wanted) {
+                uthread_preempt_disable();
+                report("timer_switch", uthreads_impl, counter, (double) total_ns / counter, "ns/op");
+                exit(0);
+            }
+        }
+        last_ns = now;
+    }
+}
+
+static void bench_timer_switch() {
+    init_library();
+    std::vector<int> ids(bench_threads);
+    wanted = ops(200);
+    spawn_all(spin_and_watch, ids);
+    spin_and_watch();
+}
+
+static void tick_forever() {
+    for (;;)
+        uthread_tick();
+}
+
+static void bench_tick_switch() {
+    uthread_config config = {};
+    config.quantum_usecs = QUANTUM_USECS;
+    config.max_threads = bench_threads + 1;
+    config.no_guard_pages = bench_threads > GUARDED_MAX_THREADS;
+    config.manual_ticks = 1;
+    if (uthread_init_config(&config) != 0)
+        exit(1);
+    std::vector<int> ids(bench_threads);
+    spawn_all(tick_forever, ids);
+    uthread_tick(); // every thread runs once
+
+    long rounds = ops(1000000) / (bench_threads + 1) > 0 ? ops(1000000) / (bench_threads + 1) : 1;
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long i = 0; i < rounds; ++i)
+        uthread_tick();
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long switches = rounds * (bench_threads + 1);
+    report("tick_switch", "uthreads-manual", switches, (double) elapsed / switches, "ns/op");
+}
+
+static void block_forever() {
+    int self = uthread_get_tid();
+    for (;;)
+        uthread_block(self);
+}
+
+static void bench_block_resume() {
+    init_library();
+    std::vector<int> ids(bench_threads);
+    spawn_all(block_forever, ids);
+    uthread_yield(); // every thread runs once, and blocks
+
+    long rounds = ops(200000);
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long i = 0; i < rounds; ++i) {
+        uthread_resume(ids[i % bench_threads]);
+        uthread_yield();
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+    report("block_resume", uthreads_impl, rounds, (double) elapsed / rounds, "ns/op");
+}
+
+static std::vector<int> posted_ids;
+static sem_t resumed;
+static volatile bool posts_done;
+
+static void block_and_signal() {
+    int self = uthread_get_tid();
+    // a resume taken between the sem_post and the block would be lost, so nothing may reschedule in between
+    uthread_preempt_disable();
+    for (;;) {
+        uthread_block(self);
+        if (posts_done)
+            break;
+        counter++;
+        sem_post(&resumed);
+    }
+    uthread_preempt_enable();
+}
+
+static void *post_resumes(void *) {
+    long rounds = ops(200000);
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long i = 0; i < rounds; ++i) {
+        if (uthread_post_resume(posted_ids[i % bench_threads]) != 0)
+            exit(1);
+        sem_wait(&resumed);
+    }
+    total_ns = clockNsecs(CLOCK_MONOTONIC) - start;
+    posts_done = true;
+    uthread_post_resume(posted_ids[0]);
+    return nullptr;
+}
+
+static void bench_post_resume() {
+    init_library();
+    sem_init(&resumed, 0, 0);
+    posted_ids.resize(bench_threads);
+    spawn_all(block_and_signal, posted_ids);
+    uthread_yield(); // every thread runs once, and blocks
+
+    // the main thread waits in the library while the pthread posts, so the worker has nothing else to run. the
+    // pthread resumes the first thread once more at the end, and it returns.
+    pthread_t poster;
+    if (pthread_create(&poster, nullptr, post_resumes, nullptr) != 0 || uthread_join(posted_ids[0], nullptr) != 0)
+        exit(1);
+    pthread_join(poster, nullptr);
+    report("post_resume", uthreads_impl, counter, (double) total_ns / counter, "ns/op");
+}
+
+static std::vector<uthread_chan_t *> pipeline;
+static int next_stage;
+
+static void relay_forever() {
+    int stage = next_stage++;
+    long element;
+    for (;;) {
+        uthread_chan_recv(pipeline[stage], &element);
+        uthread_chan_send(pipeline[stage + 1], &element);
+    }
+}
+
+static void bench_chan_pipeline() {
+    init_library();
+    pipeline.resize(bench_threads + 1);
+    for (uthread_chan_t *&chan : pipeline)
+        chan = uthread_chan_create(sizeof(long), 0);
+    std::vector<int> ids(bench_threads);
+    spawn_all(relay_forever, ids);
+    uthread_yield(); // every thread runs once, and waits on its channel
+
+    long rounds = ops(1000000) / (bench_threads + 1) > 0 ? ops(1000000) / (bench_threads + 1) : 1;
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long element = 0; element < rounds; ++element) {
+        long received;
+        uthread_chan_send(pipeline.front(), &element);
+        uthread_chan_recv(pipeline.back(), &received);
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long hops = rounds * (bench_threads + 1);
+    report("chan_pipeline", uthreads_impl, hops, (double) elapsed / hops, "ns/op");
+}
+
+static void bench_spawn_terminate() {
+    init_library();
+    std::vector<int> ids(bench_threads);
+    long rounds = ops(100000) / bench_threads > 0 ? ops(100000) / bench_threads : 1;
+
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long round = 0; round < rounds; ++round) {
+        spawn_all(yield_forever, ids);
+        for (int i = 0; i < bench_threads; ++i)
+            uthread_terminate(ids[i]);
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long threads = rounds * bench_threads;
+    report("spawn_terminate", uthreads_impl, threads, (double) elapsed / threads, "ns/op");
+}
+
+static void bench_spawn_n() {
+    init_library();
+    std::vector<int> ids(bench_threads);
+    long rounds = ops(100000) / bench_threads > 0 ? ops(100000) / bench_threads : 1;
+
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long round = 0; round < rounds; ++round) {
+        if (uthread_spawn_n(yield_forever, bench_threads, ids.data()) != 0)
+            exit(1);
+        for (int i = 0; i < bench_threads; ++i)
+            uthread_terminate(ids[i]);
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long threads = rounds * bench_threads;
+    report("spawn_n", uthreads_impl, threads, (double) elapsed / threads, "ns/op");
+}
+
+static void count_and_return() {
+    counter++;
+}
+
+static void bench_spawn_run() {
+    init_library();
+    std::vector<int> ids(bench_threads);
+    long rounds = ops(100000) / bench_threads > 0 ? ops(100000) / bench_threads : 1;
+
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long round = 0; round < rounds; ++round) {
+        spawn_all(count_and_return, ids);
+        while (counter < (round + 1) * bench_threads)
+            uthread_yield();
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long threads = rounds * bench_threads;
+    report("spawn_run", uthreads_impl, threads, (double) elapsed / threads, "ns/op");
+}
+
+static void *count_and_return_arg(void *) {
+    counter++;
+    return nullptr;
+}
+
+static void bench_spawn_join() {
+    init_library();
+    std::vector<int> ids(bench_threads);
+    long rounds = ops(100000) / bench_threads > 0 ? ops(100000) / bench_threads : 1;
+
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long round = 0; round < rounds; ++round) {
+        for (int i = 0; i < bench_threads; ++i) {
+            ids[i] = uthread_spawn_arg(count_and_return_arg, nullptr);
+            if (ids[i] < 0)
+                exit(1);
+        }
+        for (int i = 0; i < bench_threads; ++i) {
+            if (uthread_join(ids[i], nullptr) != 0)
+                exit(1);
+        }
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long threads = rounds * bench_threads;
+    report("spawn_join", uthreads_impl, threads, (double) elapsed / threads, "ns/op");
+}
+
+static void sleep_and_measure() {
+    for (;;) {
+        int before = uthread_get_total_quantums();
+        uthread_sleep(SLEEP_QUANTUMS);
+        long long late = uthread_get_total_quantums() - before - SLEEP_QUANTUMS;
+        total_ns += late;
+        if (late > max_late)
+            max_late = late;
+        counter++;
+    }
+}
+
+static void bench_sleep_late() {
+    init_library();
+    std::vector<int> ids(bench_threads);
+    wanted = ops(bench_threads > 10000 ? bench_threads : 10000);
+    spawn_all(sleep_and_measure, ids);
+
+    // the main thread keeps the quantums going
+    while (counter < wanted) {}
+    uthread_preempt_disable();
+    report("sleep_late_mean", uthreads_impl, counter, (double) total_ns / counter, "quantums");
+    report("sleep_late_max", uthreads_impl, counter, (double) max_late, "quantums");
+}
+
+/*
+ * the pthread counterparts
+ */
+
+static pthread_attr_t pthread_attributes;
+static std::vector<sem_t> pthread_wakeups;
+static sem_t main_wakeup;
+static volatile bool pthreads_done;
+
+static bool pthread_count_supported() {
+    if (bench_threads <= PTHREAD_MAX_THREADS)
+        return true;
+    printf("{\"bench\": \"pthreads\", \"impl\": \"pthreads\", \"threads\": %d, \"error\": \"skipped, too many "
+           "kernel threads\"}\n", bench_threads);
+    return false;
+}
+
+static void *pthread_ping_pong(void *arg) {
+    sem_t *wakeup = (sem_t *) arg;
+    for (;;) {
+        sem_wait(wakeup);
+        if (pthreads_done)
+            return nullptr;
+        sem_post(&main_wakeup);
+    }
+}
+
+static void bench_pthread_block_resume() {
+    if (!pthread_count_supported())
+        return;
+
+    std::vector<pthread_t> threads(bench_threads);
+    pthread_wakeups.resize(bench_threads);
+    sem_init(&main_wakeup, 0, 0);
+    for (int i = 0; i < bench_threads; ++i) {
+        sem_init(&pthread_wakeups[i], 0, 0);
+        if (pthread_create(&threads[i], &pthread_attributes, pthread_ping_pong, &pthread_wakeups[i]) != 0)
+            exit(1);
+    }
+
+    long rounds = ops(200000);
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long i = 0; i < rounds; ++i) {
+        sem_post(&pthread_wakeups[i % bench_threads]);
+        sem_wait(&main_wakeup);
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+    report("block_resume", "pthreads", rounds, (double) elapsed / rounds, "ns/op");
+
+    pthreads_done = true;
+    for (int i = 0; i < bench_threads; ++i) {
+        sem_post(&pthread_wakeups[i]);
+        pthread_join(threads[i], nullptr);
+    }
+}
+
+static void *pthread_count_and_return(void *) {
+    __sync_fetch_and_add(&counter, 1);
+    return nullptr;
+}
+
+static void bench_pthread_spawn_run() {
+    if (!pthread_count_supported())
+        return;
+
+    std::vector<pthread_t> threads(bench_threads);
+    long rounds = ops(100000) / bench_threads > 0 ? ops(100000) / bench_threads : 1;
+
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    for (long round = 0; round < rounds; ++round) {
+        for (int i = 0; i < bench_threads; ++i) {
+            if (pthread_create(&threads[i], &pthread_attributes, pthread_count_and_return, nullptr) != 0)
+                exit(1);
+        }
+        for (int i = 0; i < bench_threads; ++i)
+            pthread_join(threads[i], nullptr);
+    }
+    long long elapsed = clockNsecs(CLOCK_MONOTONIC) - start;
+
+    long total = rounds * bench_threads;
+    report("spawn_run", "pthreads", total, (double) elapsed / total, "ns/op");
+}
+
+struct Benchmark {
+    const char *name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+        {"yield_switch", bench_yield_switch},
+        {"timer_switch", bench_timer_switch},
+        {"tick_switch", bench_tick_switch},
+        {"block_resume", bench_block_resume},
+        {"pthread_block_resume", bench_pthread_block_resume},
+        {"post_resume", bench_post_resume},
+        {"chan_pipeline", bench_chan_pipeline},
+        {"spawn_terminate", bench_spawn_terminate},
+        {"spawn_n", bench_spawn_n},
+        {"spawn_run", bench_spawn_run},
+        {"spawn_join", bench_spawn_join},
+        {"pthread_spawn_run", bench_pthread_spawn_run},
+        {"sleep_late", bench_sleep_late},
+};
+
+static bool selected(const char *name, int argc, char *argv[], int first) {
+    if (first == argc)
+        return true;
+    for (int i = first; i < argc; ++i) {
+        if (strcmp(argv[i], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * runs the benchmark in a child process, and reports its failure if it failed
+ */
+static void run_isolated(const Benchmark &benchmark) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (child == 0) {
+        benchmark.run();
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("{\"bench\": \"%s\", \"threads\": %d, \"error\": \"exit status %d\"}\n", benchmark.name,
+               bench_threads, status);
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<int> thread_counts = {10, 100, 1000, 10000, 100000};
+    int opt;
+    while ((opt = getopt(argc, argv, "qTt:")) != -1) {
+        if (opt == 'q') {
+            scale = 10;
+        } else if (opt == 'T') {
+            tickless = true;
+            uthreads_impl = "uthreads-tickless";
+        } else if (opt == 't') {
+            thread_counts.clear();
+            for (char *count = strtok(optarg, ","); count != nullptr; count = strtok(nullptr, ","))
+                thread_counts.push_back(atoi(count));
+        } else {
+            fprintf(stderr, "usage: %s [-q] [-T] [-t threads,...] [bench ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (int count : thread_counts) {
+        if (count <= 0) {
+            fprintf(stderr, "thread counts must be positive\n");
+            return 1;
+        }
+    }
+
+    pthread_attr_init(&pthread_attributes);
+    pthread_attr_setstacksize(&pthread_attributes, PTHREAD_STACK_SIZE);
+
+    for (const Benchmark &benchmark : benchmarks) {
+        if (!selected(benchmark.name, argc, argv, optind))
+            continue;
+        for (int count : thread_counts) {
+            bench_threads = count;
+            run_isolated(benchmark);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,626 @@
+/*
+ * Behaviour tests of the library, the cases the benchmarks do not exercise:
+ *   mutex_handoff     - an unlocked mutex goes to its waiters in FIFO order, before a thread that locks it again
+ *   sem_timeout       - a semaphore whose waiter timed out still counts every post
+ *   chan_select_close - uthread_chan_select over several channels, and what closing a channel does to its waiters,
+ *                       its buffer and later operations
+ *   join_detach       - uthread_join returns the start routine's result, a zombie keeps its ID until it is joined
+ *                       or detached, and a detached thread releases it as soon as it terminates
+ *   terminate_waiting - a thread terminated while it waits for a mutex, a condition variable, a channel or an fd
+ *                       leaves the wait, without taking the mutex, a signal, an element or the fd's data, and (in
+ *                       tickless mode) without keeping the timer running
+ *   stale_post        - a uthread_post_resume still pending when its thread terminates does not resume the thread
+ *                       given the ID next
+ *   tickless          - in tickless mode, a lone thread that spins is not interrupted, and one that spins while
+ *                       another thread is READY is preempted by the periodic timer
+ *   stats             - uthread_yield to a READY thread counts as a switch of the thread and of the library, and a
+ *                       thread that spins shows the CPU time it consumed
+ *   specific          - every thread keeps its own uthread-local values, their destructors run when a thread
+ *                       terminates itself or is terminated, and a deleted key's index created again reads NULL
+ *   manual_ticks      - with manual_ticks, calls to uthread_tick switch the threads in the one fixed round robin
+ *                       order, and the mode is refused with several workers
+ *
+ * The library can be initialized only once, so every test runs in a child process of its own. A test that fails
+ * prints the check that failed, and a test that hangs is killed after TEST_TIMEOUT_SECS seconds.
+ * Some checks provoke library errors on purpose, whose messages are printed to stderr.
+ *
+ * usage: uthread_test [-T] [-w workers] [test ...]
+ *   -T  initialize the library in tickless mode
+ *   -w  the number of kernel threads running the threads, default 1
+ *   test  the tests to run, default all of them
+ * exits with status 1 if a test failed.
+ */
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "uthreads.h"
+#include "Clock.h"
+
+#define QUANTUM_USECS 1000
+#define SETTLE_USECS (5 * QUANTUM_USECS) /* long enough for a spawned thread to start waiting */
+#define TEST_TIMEOUT_SECS 20
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            fflush(stdout); \
+            _exit(1); \
+        } \
+    } while (0)
+
+static int workers = 1;
+static bool tickless = false;
+
+// the state the threads of a test share (each test runs in a process of its own)
+static std::atomic<int> arrived{0};
+static std::atomic<int> finished{0};
+static std::atomic<int> result{-2};
+static int order[3];
+static uthread_mutex_t mutex = UTHREAD_MUTEX_INITIALIZER;
+static uthread_cond_t cond = UTHREAD_COND_INITIALIZER;
+static uthread_sem_t sem;
+static uthread_chan_t *chan;
+static int fds[2];
+
+static void init_library() {
+    uthread_config config = {};
+    config.quantum_usecs = QUANTUM_USECS;
+    config.workers = workers;
+    config.tickless = tickless;
+    if (uthread_init_config(&config) != 0)
+        exit(1);
+}
+
+/*
+ * sleeps until the counter reaches the value
+ */
+static void wait_for(const std::atomic<int> &counter, int value) {
+    while (counter.load() < value)
+        uthread_sleep_usec(100);
+}
+
+/*
+ * spins on the CPU for the number of quantums, in real time
+ */
+static void spin_quantums(int quantums) {
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    while (clockNsecs(CLOCK_MONOTONIC) - start < quantums * QUANTUM_USECS * 1000LL) {}
+}
+
+static void spawn(thread_entry_point entry) {
+    CHECK(uthread_spawn(entry) > 0);
+}
+
+static void lock_in_turn() {
+    int turn = arrived++;
+    uthread_mutex_lock(&mutex);
+    order[finished++] = turn;
+    uthread_mutex_unlock(&mutex);
+}
+
+static void test_mutex_handoff() {
+    init_library();
+    CHECK(uthread_mutex_lock(&mutex) == 0);
+    for (int i = 0; i < 3; ++i) {
+        spawn(lock_in_turn);
+        wait_for(arrived, i + 1);
+        uthread_sleep_usec(SETTLE_USECS);
+    }
+
+    // the mutex goes to the first waiter, so locking it again waits for all three
+    CHECK(uthread_mutex_unlock(&mutex) == 0);
+    CHECK(uthread_mutex_lock(&mutex) == 0);
+    CHECK(finished == 3);
+    CHECK(order[0] == 0 && order[1] == 1 && order[2] == 2);
+    CHECK(uthread_mutex_unlock(&mutex) == 0);
+}
+
+static void wait_sem_briefly() {
+    result = uthread_sem_timedwait(&sem, 2 * QUANTUM_USECS);
+}
+
+static void wait_sem() {
+    result = uthread_sem_wait(&sem);
+}
+
+static void test_sem_timeout() {
+    init_library();
+    CHECK(uthread_sem_init(&sem, 0) == 0);
+    spawn(wait_sem_briefly);
+    while (result == -2)
+        uthread_sleep_usec(100);
+    CHECK(result == 1);
+
+    // the post is not lost on the waiter that timed out
+    CHECK(uthread_sem_post(&sem) == 0);
+    CHECK(uthread_sem_trywait(&sem) == 0);
+    CHECK(uthread_sem_trywait(&sem) == -1);
+
+    result = -2;
+    spawn(wait_sem);
+    uthread_sleep_usec(SETTLE_USECS);
+    CHECK(result == -2);
+    CHECK(uthread_sem_post(&sem) == 0);
+    while (result == -2)
+        uthread_sleep_usec(100);
+    CHECK(result == 0);
+    CHECK(uthread_sem_trywait(&sem) == -1);
+    CHECK(uthread_sem_destroy(&sem) == 0);
+}
+
+static void send_seven() {
+    int seven = 7;
+    uthread_chan_send(chan, &seven);
+}
+
+static void recv_once() {
+    int elem = -1;
+    result = uthread_chan_recv(chan, &elem);
+    order[0] = elem;
+}
+
+static void test_chan_select_close() {
+    init_library();
+    uthread_chan_t *idle = uthread_chan_create(sizeof(int), 0);
+    chan = uthread_chan_create(sizeof(int), 0);
+    CHECK(idle != nullptr && chan != nullptr);
+    int a = -1, b = -1;
+    uthread_chan_op ops[2] = {{idle, UTHREAD_CHAN_RECV, &a, 0}, {chan, UTHREAD_CHAN_RECV, &b, 0}};
+    CHECK(uthread_chan_select(ops, 2, 0) == -1);
+    spawn(send_seven);
+    CHECK(uthread_chan_select(ops, 2, 1) == 1);
+    CHECK(b == 7 && ops[1].ok == 1 && a == -1);
+
+    // closing wakes the waiting receiver, which receives nothing
+    spawn(recv_once);
+    uthread_sleep_usec(SETTLE_USECS);
+    CHECK(result == -2);
+    CHECK(uthread_chan_close(chan) == 0);
+    while (result == -2)
+        uthread_sleep_usec(100);
+    CHECK(result == -1 && order[0] == 0);
+
+    // a closed channel's buffer is drained before receives fail, and a select case on it then goes ahead
+    uthread_chan_t *buffered = uthread_chan_create(sizeof(int), 2);
+    int elem = 5;
+    CHECK(uthread_chan_send(buffered, &elem) == 0);
+    CHECK(uthread_chan_close(buffered) == 0);
+    CHECK(uthread_chan_send(buffered, &elem) == -1);
+    elem = -1;
+    CHECK(uthread_chan_recv(buffered, &elem) == 0 && elem == 5);
+    CHECK(uthread_chan_recv(buffered, &elem) == -1 && elem == 0);
+    ops[1] = {buffered, UTHREAD_CHAN_RECV, &b, 1};
+    CHECK(uthread_chan_select(ops, 2, 1) == 1);
+    CHECK(ops[1].ok == 0);
+
+    CHECK(uthread_chan_destroy(idle) == 0);
+    CHECK(uthread_chan_destroy(chan) == 0);
+    CHECK(uthread_chan_destroy(buffered) == 0);
+}
+
+static void *return_arg(void *arg) {
+    finished++;
+    return arg;
+}
+
+static void *wait_then_return(void *arg) {
+    uthread_mutex_lock(&mutex);
+    uthread_mutex_unlock(&mutex);
+    finished++;
+    return arg;
+}
+
+static void test_join_detach() {
+    init_library();
+    void *returned = nullptr;
+    int tid = uthread_spawn_arg(return_arg, (void *) 42);
+    CHECK(tid > 0);
+    CHECK(uthread_join(tid, &returned) == 0);
+    CHECK(returned == (void *) 42);
+    CHECK(uthread_join(tid, nullptr) == -1);
+
+    // a zombie keeps its ID, until it is detached
+    finished = 0;
+    int zombie = uthread_spawn_arg(return_arg, nullptr);
+    CHECK(zombie > 0);
+    wait_for(finished, 1);
+    uthread_sleep_usec(SETTLE_USECS);
+    int other = uthread_spawn_arg(return_arg, nullptr);
+    CHECK(other > 0 && other != zombie);
+    CHECK(uthread_join(other, nullptr) == 0);
+    CHECK(uthread_detach(zombie) == 0);
+    CHECK(uthread_join(zombie, nullptr) == -1);
+    tid = uthread_spawn_arg(return_arg, (void *) 1);
+    CHECK(tid == zombie);
+    CHECK(uthread_join(tid, &returned) == 0 && returned == (void *) 1);
+
+    // a thread detached while it runs is released when it terminates
+    finished = 0;
+    CHECK(uthread_mutex_lock(&mutex) == 0);
+    tid = uthread_spawn_arg(wait_then_return, nullptr);
+    CHECK(tid > 0);
+    CHECK(uthread_detach(tid) == 0);
+    CHECK(uthread_mutex_unlock(&mutex) == 0);
+    wait_for(finished, 1);
+    uthread_sleep_usec(SETTLE_USECS);
+    other = uthread_spawn_arg(return_arg, nullptr);
+    CHECK(other == tid);
+    CHECK(uthread_join(other, nullptr) == 0);
+}
+
+static void lock_mutex() {
+    uthread_mutex_lock(&mutex);
+    finished++;
+    uthread_mutex_unlock(&mutex);
+}
+
+static void wait_cond() {
+    uthread_mutex_lock(&mutex);
+    arrived++;
+    uthread_cond_wait(&cond, &mutex);
+    finished++;
+    uthread_mutex_unlock(&mutex);
+}
+
+static void recv_forever() {
+    int elem;
+    uthread_chan_recv(chan, &elem);
+    finished++;
+}
+
+static void read_pipe() {
+    char byte;
+    uthread_read(fds[0], &byte, 1);
+    finished++;
+}
+
+/*
+ * spawns a thread that starts waiting, and terminates it while it waits
+ */
+static void terminate_while_waiting(thread_entry_point entry) {
+    int tid = uthread_spawn(entry);
+    CHECK(tid > 0);
+    uthread_sleep_usec(SETTLE_USECS);
+    CHECK(uthread_terminate(tid) == 0);
+}
+
+static void test_terminate_waiting() {
+    init_library();
+
+    // the mutex is not handed over to the terminated waiter
+    CHECK(uthread_mutex_lock(&mutex) == 0);
+    terminate_while_waiting(lock_mutex);
+    CHECK(uthread_mutex_unlock(&mutex) == 0);
+    CHECK(uthread_mutex_trylock(&mutex) == 0);
+    CHECK(uthread_mutex_unlock(&mutex) == 0);
+
+    // a signal is not spent on the terminated waiter
+    terminate_while_waiting(wait_cond);
+    spawn(wait_cond);
+    wait_for(arrived, 2);
+    CHECK(uthread_mutex_lock(&mutex) == 0);
+    CHECK(uthread_cond_signal(&cond) == 0);
+    CHECK(uthread_mutex_unlock(&mutex) == 0);
+    wait_for(finished, 1);
+
+    // nor an element, which no receiver is left to take
+    chan = uthread_chan_create(sizeof(int), 0);
+    CHECK(chan != nullptr);
+    terminate_while_waiting(recv_forever);
+    int elem = 1;
+    CHECK(uthread_chan_timedsend(chan, &elem, 2 * QUANTUM_USECS) == 1);
+    CHECK(uthread_chan_destroy(chan) == 0);
+
+    // nor the fd's data, and the fd is not watched any more
+    CHECK(pipe(fds) == 0);
+    terminate_while_waiting(read_pipe);
+    if (tickless && workers == 1) {
+        // alone, the main thread has nothing to be preempted for, and nothing to poll for
+        int before = uthread_get_total_quantums();
+        spin_quantums(20);
+        CHECK(uthread_get_total_quantums() == before);
+    }
+    char byte = 'x';
+    CHECK(write(fds[1], &byte, 1) == 1);
+    byte = 0;
+    CHECK(uthread_read(fds[0], &byte, 1) == 1 && byte == 'x');
+    CHECK(finished == 1);
+}
+
+static std::atomic<bool> counting{false};
+
+static void count_run() {
+    // run by another worker before the main thread blocked it, it only yields until the block takes effect
+    while (!counting)
+        uthread_yield();
+    finished++;
+}
+
+static void sleep_long() {
+    uthread_sleep(TEST_TIMEOUT_SECS * 1000000 / QUANTUM_USECS);
+    finished++;
+}
+
+static void test_stale_post() {
+    init_library();
+    // blocked while it sleeps, so the post only puts it back to sleep if another worker takes it right away
+    int tid = uthread_spawn(sleep_long);
+    CHECK(tid > 0);
+    uthread_sleep_usec(SETTLE_USECS);
+    CHECK(uthread_block(tid) == 0);
+
+    // no scheduling decision on this worker between the post and the block of the new thread
+    CHECK(uthread_preempt_disable() == 0);
+    CHECK(uthread_post_resume(tid) == 0);
+    CHECK(uthread_terminate(tid) == 0);
+    CHECK(uthread_spawn(count_run) == tid);
+    CHECK(uthread_block(tid) == 0);
+    CHECK(uthread_preempt_enable() == 0);
+
+    uthread_sleep_usec(SETTLE_USECS);
+    counting = true;
+    uthread_sleep_usec(SETTLE_USECS);
+    CHECK(finished == 0);
+    CHECK(uthread_resume(tid) == 0);
+    wait_for(finished, 1);
+}
+
+static void count_once() {
+    finished++;
+}
+
+static void test_tickless() {
+    // ignores -T and -w: a single worker has nothing but the timer to run another thread
+    uthread_config config = {};
+    config.quantum_usecs = QUANTUM_USECS;
+    config.tickless = 1;
+    CHECK(uthread_init_config(&config) == 0);
+
+    int before = uthread_get_total_quantums();
+    spin_quantums(20);
+    CHECK(uthread_get_total_quantums() == before);
+
+    // the main thread never yields, only the timer lets the new thread run
+    spawn(count_once);
+    long long start = clockNsecs(CLOCK_MONOTONIC);
+    while (finished == 0)
+        CHECK(clockNsecs(CLOCK_MONOTONIC) - start < 1000LL * 1000000 * TEST_TIMEOUT_SECS / 2);
+    CHECK(uthread_get_total_quantums() > before);
+
+    // alone again, the timer stops once it found nothing READY
+    spin_quantums(5);
+    before = uthread_get_total_quantums();
+    spin_quantums(20);
+    CHECK(uthread_get_total_quantums() == before);
+}
+
+#define STATS_YIELDS 10
+
+static void yield_back() {
+    while (finished == 0)
+        uthread_yield();
+}
+
+static void spin_and_block() {
+    spin_quantums(5);
+    arrived++;
+    uthread_block(uthread_get_tid());
+}
+
+static void test_stats() {
+    // ignores -w: with a single worker, the main thread and the thread it yields to take turns
+    uthread_config config = {};
+    config.quantum_usecs = QUANTUM_USECS;
+    config.tickless = tickless;
+    config.collect_stats = 1;
+    CHECK(uthread_init_config(&config) == 0);
+
+    uthread_stats stats;
+    uthread_global_stats global;
+    CHECK(uthread_get_stats(0, &stats) == 0);
+    CHECK(uthread_get_global_stats(&global) == 0);
+    long long voluntary = stats.voluntary_switches, switches = global.switches;
+    spawn(yield_back);
+    for (int i = 0; i < STATS_YIELDS; ++i)
+        CHECK(uthread_yield() == 0);
+    finished++;
+    CHECK(uthread_get_stats(0, &stats) == 0);
+    CHECK(uthread_get_global_stats(&global) == 0);
+    CHECK(stats.voluntary_switches >= voluntary + STATS_YIELDS);
+    CHECK(global.switches >= switches + 2 * STATS_YIELDS);
+
+    int tid = uthread_spawn(spin_and_block);
+    CHECK(tid > 0);
+    wait_for(arrived, 1);
+    CHECK(uthread_get_stats(tid, &stats) == 0);
+    CHECK(stats.cpu_nsecs >= 2 * QUANTUM_USECS * 1000LL);
+    CHECK(uthread_get_global_stats(&global) == 0);
+    CHECK(global.threads == 2);
+}
+
+static uthread_key_t key;
+static std::atomic<int> destroyed{0};
+
+static void destroy_value(void *value) {
+    destroyed += (int)(intptr_t)value;
+}
+
+static void keep_value() {
+    int value = ++arrived;
+    CHECK(uthread_getspecific(key) == nullptr);
+    CHECK(uthread_setspecific(key, (void *)(intptr_t)value) == 0);
+    // all three hold a value at once, and sleep in between to interleave
+    wait_for(arrived, 3);
+    CHECK(uthread_getspecific(key) == (void *)(intptr_t)value);
+    finished++;
+}
+
+static void keep_value_sleeping() {
+    CHECK(uthread_setspecific(key, (void *)(intptr_t)1000) == 0);
+    arrived++;
+    uthread_sleep(TEST_TIMEOUT_SECS * 1000000 / QUANTUM_USECS);
+}
+
+static void test_specific() {
+    init_library();
+    CHECK(uthread_key_create(&key, destroy_value) == 0);
+    CHECK(uthread_setspecific(key, (void *)(intptr_t)100) == 0);
+    for (int i = 0; i < 3; ++i)
+        spawn(keep_value);
+    wait_for(finished, 3);
+    // the threads returned, each destroying its own value: 1 + 2 + 3
+    while (destroyed != 6)
+        uthread_sleep_usec(100);
+    CHECK(uthread_getspecific(key) == (void *)(intptr_t)100);
+
+    // the terminating thread destroys the values of the thread it terminated
+    int tid = uthread_spawn(keep_value_sleeping);
+    CHECK(tid > 0);
+    wait_for(arrived, 4);
+    uthread_sleep_usec(SETTLE_USECS); // asleep, not running on another worker, which would drop its values
+    CHECK(uthread_terminate(tid) == 0);
+    CHECK(destroyed == 1006);
+
+    // the values of a deleted key are dropped, also for the key created at its index next
+    CHECK(uthread_key_delete(key) == 0);
+    CHECK(uthread_getspecific(key) == nullptr);
+    uthread_key_t reused;
+    CHECK(uthread_key_create(&reused, nullptr) == 0);
+    CHECK(reused == key);
+    CHECK(uthread_getspecific(reused) == nullptr);
+    CHECK(uthread_setspecific(reused, (void *)(intptr_t)200) == 0);
+    CHECK(uthread_getspecific(reused) == (void *)(intptr_t)200);
+    CHECK(destroyed == 1006);
+}
+
+#define TICK_ROUNDS 5
+#define TICK_THREADS 3
+
+// the tid of the thread that ran each tick, in manual tick mode (only one thread runs at a time)
+static int ticked[2 * (TICK_THREADS + 1) * (TICK_ROUNDS + 1)];
+static int ticks = 0;
+
+static void tick_twice() {
+    for (int i = 0; i < 2; ++i) {
+        if (ticks < (int)(sizeof(ticked) / sizeof(ticked[0])))
+            ticked[ticks++] = uthread_get_tid();
+        CHECK(uthread_tick() == 0);
+    }
+}
+
+static void tick_rounds() {
+    for (int round = 0; round < TICK_ROUNDS; ++round)
+        tick_twice();
+    finished++;
+}
+
+static void test_manual_ticks() {
+    // ignores -T and -w: manual ticks are refused with several workers, and with tickless mode
+    uthread_config config = {};
+    config.manual_ticks = 1;
+    config.quantum_ticks = 2;
+    config.workers = 2;
+    CHECK(uthread_init_config(&config) == -1);
+    config.workers = 1;
+    config.tickless = 1;
+    CHECK(uthread_init_config(&config) == -1);
+    config.tickless = 0;
+    CHECK(uthread_init_config(&config) == 0);
+
+    for (int i = 1; i <= TICK_THREADS; ++i)
+        CHECK(uthread_spawn(tick_rounds) == i);
+    while (finished < TICK_THREADS)
+        tick_twice();
+
+    // a quantum lasts two ticks, then the next READY thread runs, in the order the threads were spawned
+    for (int i = 0; i < 2 * (TICK_THREADS + 1) * TICK_ROUNDS; ++i)
+        CHECK(ticked[i] == i / 2 % (TICK_THREADS + 1));
+    CHECK(uthread_get_total_quantums() > (TICK_THREADS + 1) * TICK_ROUNDS);
+}
+
+struct Test {
+    const char *name;
+    void (*run)();
+};
+
+static const Test tests[] = {
+        {"mutex_handoff", test_mutex_handoff},
+        {"sem_timeout", test_sem_timeout},
+        {"chan_select_close", test_chan_select_close},
+        {"join_detach", test_join_detach},
+        {"terminate_waiting", test_terminate_waiting},
+        {"stale_post", test_stale_post},
+        {"tickless", test_tickless},
+        {"stats", test_stats},
+        {"specific", test_specific},
+        {"manual_ticks", test_manual_ticks},
+};
+
+static bool selected(const char *name, int argc, char *argv[], int first) {
+    if (first == argc)
+        return true;
+    for (int i = first; i < argc; ++i) {
+        if (strcmp(argv[i], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * runs the test in a child process
+ * @return true if it passed
+ */
+static bool run_isolated(const Test &test) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (child == 0) {
+        alarm(TEST_TIMEOUT_SECS);
+        test.run();
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    bool passed = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (passed)
+        printf("ok   %s\n", test.name);
+    else
+        printf("FAIL %s (exit status %d)\n", test.name, status);
+    fflush(stdout);
+    return passed;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "Tw:")) != -1) {
+        if (opt == 'T') {
+            tickless = true;
+        } else if (opt == 'w') {
+            workers = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-T] [-w workers] [test ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (workers <= 0) {
+        fprintf(stderr, "the number of workers must be positive\n");
+        return 1;
+    }
+
+    bool passed = true;
+    for (const Test &test : tests) {
+        if (selected(test.name, argc, argv, optind))
+            passed = run_isolated(test) && passed;
+    }
+    return passed ? 0 : 1;
+}
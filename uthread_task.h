@@ -0,0 +1,797 @@
+#ifndef OS_EX2_UTHREAD_TASK_H
+#define OS_EX2_UTHREAD_TASK_H
+
+/*
+ * Stackless tasks (C++20 coroutines) on the uthread scheduler.
+ *
+ * A uthread::task<T> is a coroutine returning a T. It starts when it is co_awaited, or when it is handed to
+ * uthread::spawn, and costs only its coroutine frame (its locals and a few pointers), not a stack and a thread.
+ * Tasks run on a few carrier uthreads, which the scheduler schedules like any other thread: a carrier resumes the
+ * ready tasks one after the other, and waits like any thread when there are none. Within a task:
+ *   co_await other_task()                 runs the other task, and returns its result (or rethrows its exception)
+ *   co_await uthread::yield()             lets the other ready tasks run first
+ *   co_await uthread::sleep_for(usecs)    suspends the task for usecs microseconds of CLOCK_MONOTONIC
+ *   co_await uthread::chan_send(c, &e)    and chan_recv: uthread_chan_send / uthread_chan_recv, that suspend the
+ *                                         task rather than the carrier
+ *   co_await mutex.lock()                 locks a uthread::task_mutex
+ * A task must not call the blocking library calls (uthread_mutex_lock, uthread_sleep, uthread_read...) itself, as they
+ * block the carrier and every task waiting for it. A uthread_mutex_t cannot be used across a co_await either: its
+ * owner is the carrier, and the task may resume on another one.
+ *
+ * Tasks are not entries of the scheduler's ready queues: the scheduler only sees the carriers. Each carrier has a FIFO
+ * line of ready tasks of its own, guarded by a spin lock, so carriers do not contend with each other as long as they
+ * have work: a task made ready by a task goes to the line of the carrier it runs on, and one made ready by a thread
+ * goes to the lines in turn. A carrier whose line is empty steals the older half of another carrier's line, like the
+ * workers do with threads. start_tasks(workers) therefore gives each worker a line of tasks, of the carrier it runs.
+ * The scheduling policy (MLFQ levels), the statistics and the trace apply to the carriers, not to each task. Carriers
+ * are preempted like any thread, so tasks as a whole share the CPU with plain threads by the scheduler's policy, but
+ * among themselves tasks are cooperative: a task that runs long without a co_await holds its carrier, and the tasks
+ * in its line wait until the other carriers steal them (or until it gives the carrier up, with a single carrier).
+ *
+ * Library calls are made from the carriers, so start_tasks must be called (once, from a thread, after uthread_init)
+ * before the first task is spawned. The header is not part of the library, which is built as C++11.
+ */
+
+#include <coroutine>
+#include <atomic>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <time.h>
+#include "uthreads.h"
+#include "SpinLock.h"
+
+namespace uthread {
+
+template<typename T = void>
+class task;
+
+namespace detail {
+
+/*
+ * a suspended coroutine in a queue of the executor. it lives in the coroutine's frame (in its awaiter, or its
+ * promise), so queueing it allocates nothing.
+ */
+struct node {
+    std::coroutine_handle<> handle;
+    node *next = nullptr;
+};
+
+struct timer_entry {
+    long long deadline;
+    node *waiter;
+};
+
+inline bool later(const timer_entry &a, const timer_entry &b) {
+    return a.deadline > b.deadline;
+}
+
+/*
+ * the line of ready tasks of a carrier. the spin locks of the lines and of the timer heap are taken with preemption
+ * disabled, and never two at once: a holder cannot be preempted, so on a single worker they are never contended,
+ * and growing the timer heap cannot be preempted inside malloc.
+ */
+struct alignas(64) ready_line {
+    SpinLock lock;
+    node *head = nullptr;
+    node *tail = nullptr;
+    std::atomic<int> length{0}; // read without the lock by carriers looking for tasks to steal
+
+    /*
+     * adds the chain of count tasks from first to last to the tail
+     */
+    void push(node *first, node *last, int count) {
+        last->next = nullptr;
+        lock.lock();
+        if (tail != nullptr)
+            tail->next = first;
+        else
+            head = first;
+        tail = last;
+        length.store(length.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        lock.unlock();
+    }
+
+    /*
+     * takes the task at the head, or returns nullptr if there is none
+     */
+    node *pop() {
+        if (length.load(std::memory_order_relaxed) == 0)
+            return nullptr;
+        lock.lock();
+        node *first = head;
+        if (first != nullptr) {
+            head = first->next;
+            if (head == nullptr)
+                tail = nullptr;
+            length.store(length.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        }
+        lock.unlock();
+        return first;
+    }
+
+    /*
+     * takes the older half of the victim's tasks (at least one), and moves all but the first of them to this line
+     * @return the first task taken, or nullptr if the victim had none
+     */
+    node *steal_from(ready_line *victim) {
+        victim->lock.lock();
+        int count = (victim->length.load(std::memory_order_relaxed) + 1) / 2;
+        node *first = victim->head;
+        node *last = first;
+        for (int i = 1; i < count; ++i)
+            last = last->next;
+        if (count > 0) {
+            victim->head = last->next;
+            if (victim->head == nullptr)
+                victim->tail = nullptr;
+            victim->length.store(victim->length.load(std::memory_order_relaxed) - count, std::memory_order_relaxed);
+        }
+        victim->lock.unlock();
+        if (count > 1)
+            push(first->next, last, count - 1);
+        return count > 0 ? first : nullptr;
+    }
+};
+
+/*
+ * what the carriers and the timer thread share
+ */
+struct executor {
+    uthread_sem_t work; // a unit per ready task, idle carriers wait for one
+    int carriers = 0;
+    ready_line *lines = nullptr; // a line per carrier
+    uthread_key_t line_key = 0; // each carrier's value is its line, other threads have none
+    std::atomic<unsigned> next_line{0}; // the line the next task made ready by a thread goes to
+    // tasks whose channel operation completed, pushed from within the library (which cannot take a lock) before it
+    // posts work, latest first
+    std::atomic<node *> completed{nullptr};
+    SpinLock timers_lock;
+    std::vector<timer_entry> timers; // a min-heap by deadline
+    uthread_sem_t timer; // posted for a new earliest deadline, the timer thread waits for it until the earliest one
+    std::atomic<int> started{0}; // the executor threads that started
+};
+
+inline executor *the_executor = nullptr;
+
+inline long long now_nsecs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+ * the line of the calling carrier, or the next line in turn if it is called from another thread
+ */
+inline ready_line *line_for_ready() {
+    executor *e = the_executor;
+    auto *own = static_cast<ready_line *>(uthread_getspecific(e->line_key));
+    if (own != nullptr)
+        return own;
+    return &e->lines[e->next_line.fetch_add(1, std::memory_order_relaxed) % e->carriers];
+}
+
+/*
+ * makes the task ready, from within the library, see chan_awaiter
+ */
+inline void push_completed(node *waiter) {
+    std::atomic<node *> &completed = the_executor->completed;
+    node *top = completed.load(std::memory_order_relaxed);
+    do {
+        waiter->next = top;
+    } while (!completed.compare_exchange_weak(top, waiter, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/*
+ * moves the completed tasks to the tail of the line, in the order they completed, with preemption disabled
+ */
+inline void take_completed(ready_line *line) {
+    executor *e = the_executor;
+    if (e->completed.load(std::memory_order_relaxed) == nullptr)
+        return;
+    node *top = e->completed.exchange(nullptr, std::memory_order_acquire);
+    if (top == nullptr)
+        return;
+    node *last = top;
+    node *first = nullptr;
+    int count = 0;
+    while (top != nullptr) {
+        node *next = top->next;
+        top->next = first;
+        first = top;
+        top = next;
+        count++;
+    }
+    line->push(first, last, count);
+}
+
+/*
+ * makes the task ready. the task may be resumed by another carrier before this returns.
+ */
+inline void schedule(node *waiter) {
+    ready_line *line = line_for_ready();
+    uthread_preempt_disable();
+    line->push(waiter, waiter, 1);
+    uthread_preempt_enable();
+    uthread_sem_post(&the_executor->work);
+}
+
+/*
+ * takes the next task for the carrier of the line: a completed one or the head of its own line, or else one stolen
+ * from the longest other line. called with preemption disabled.
+ * @return the task, or nullptr if none was found
+ */
+inline node *take_next(ready_line *own) {
+    executor *e = the_executor;
+    take_completed(own);
+    node *next = own->pop();
+    if (next != nullptr)
+        return next;
+
+    ready_line *victim = nullptr;
+    int victim_length = 0;
+    for (int i = 0; i < e->carriers; ++i) {
+        int length = &e->lines[i] != own ? e->lines[i].length.load(std::memory_order_relaxed) : 0;
+        if (length > victim_length) {
+            victim = &e->lines[i];
+            victim_length = length;
+        }
+    }
+    return victim != nullptr ? own->steal_from(victim) : nullptr;
+}
+
+inline void carrier(ready_line *own) {
+    executor *e = the_executor;
+    uthread_setspecific(e->line_key, own);
+    for (;;) {
+        // a unit is only posted once its task is in a line or in completed, so there is one to take
+        uthread_sem_wait(&e->work);
+        uthread_preempt_disable();
+        node *next;
+        while ((next = take_next(own)) == nullptr) {
+            // another carrier is moving it between lines, with preemption disabled: it is back in one right away
+            uthread_preempt_enable();
+            uthread_yield();
+            uthread_preempt_disable();
+        }
+        uthread_preempt_enable();
+        next->handle.resume();
+    }
+}
+
+inline void timer_thread() {
+    executor *e = the_executor;
+    for (;;) {
+        // the tasks that are due are chained, and made ready once the heap is unlocked
+        node *due = nullptr;
+        long long wait_usecs = -1;
+        uthread_preempt_disable();
+        e->timers_lock.lock();
+        long long now = now_nsecs();
+        while (!e->timers.empty() && e->timers.front().deadline <= now) {
+            std::pop_heap(e->timers.begin(), e->timers.end(), later);
+            e->timers.back().waiter->next = due;
+            due = e->timers.back().waiter;
+            e->timers.pop_back();
+        }
+        if (!e->timers.empty())
+            wait_usecs = (e->timers.front().deadline - now + 999) / 1000;
+        e->timers_lock.unlock();
+        uthread_preempt_enable();
+
+        while (due != nullptr) {
+            node *next = due->next;
+            schedule(due);
+            due = next;
+        }
+        if (wait_usecs < 0)
+            uthread_sem_wait(&e->timer);
+        else
+            uthread_sem_timedwait(&e->timer, wait_usecs);
+    }
+}
+
+/*
+ * the thread start_tasks starts carriers + 1 of: the first to run wakes the sleeping tasks, the others are carriers
+ */
+inline void executor_thread() {
+    int index = the_executor->started.fetch_add(1);
+    if (index == 0)
+        timer_thread();
+    else
+        carrier(&the_executor->lines[index - 1]);
+}
+
+/*
+ * coroutine frames are allocated with preemption disabled, like everything the library allocates
+ */
+struct frame_allocation {
+    static void *operator new(size_t size) {
+        uthread_preempt_disable();
+        void *frame = ::operator new(size);
+        uthread_preempt_enable();
+        return frame;
+    }
+
+    static void operator delete(void *frame) {
+        uthread_preempt_disable();
+        ::operator delete(frame);
+        uthread_preempt_enable();
+    }
+};
+
+struct promise_base : frame_allocation {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept {
+        return {};
+    }
+
+    // a finished task goes straight on to the task that awaited it
+    struct final_awaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept {
+            std::coroutine_handle<> continuation = finished.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    final_awaiter final_suspend() noexcept {
+        return {};
+    }
+
+    void unhandled_exception() {
+        exception = std::current_exception();
+    }
+};
+
+template<typename T>
+struct promise : promise_base {
+    std::optional<T> value;
+
+    task<T> get_return_object();
+
+    template<typename U>
+    void return_value(U &&result) {
+        value.emplace(std::forward<U>(result));
+    }
+
+    T take() {
+        if (exception)
+            std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+};
+
+template<>
+struct promise<void> : promise_base {
+    task<void> get_return_object();
+
+    void return_void() {}
+
+    void take() {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+/*
+ * a coroutine nobody awaits, that deletes itself once it is done
+ */
+struct detached {
+    struct promise_type : frame_allocation {
+        node start;
+
+        detached get_return_object() {
+            return detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+
+    void start() {
+        handle.promise().start.handle = handle;
+        schedule(&handle.promise().start);
+    }
+};
+
+inline detached run_detached(task<void> spawned);
+
+template<typename T>
+detached run_blocking(task<T> &awaited, std::optional<T> *result, std::exception_ptr *exception, uthread_sem_t *done);
+
+inline detached run_blocking(task<void> &awaited, std::exception_ptr *exception, uthread_sem_t *done);
+
+} // namespace detail
+
+/**
+ * A coroutine that returns a T (see the top of the file). A task is started by co_awaiting it, by spawn, or by
+ * block_on, once. Tasks are moved, not copied, and the coroutine frame is deleted with the task.
+ */
+template<typename T>
+class task {
+public:
+    using promise_type = detail::promise<T>;
+
+    task(task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    task &operator=(task &&other) noexcept {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+
+    ~task() {
+        if (handle)
+            handle.destroy();
+    }
+
+    struct awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        // the awaiting task is suspended, and the awaited one runs right away on the same carrier
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        T await_resume() {
+            return handle.promise().take();
+        }
+    };
+
+    awaiter operator co_await() & noexcept {
+        return awaiter{handle};
+    }
+
+    awaiter operator co_await() && noexcept {
+        return awaiter{handle};
+    }
+
+private:
+    friend struct detail::promise<T>;
+
+    explicit task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+template<typename T>
+task<T> promise<T>::get_return_object() {
+    return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() {
+    return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+inline detached run_detached(task<void> spawned) {
+    co_await spawned;
+}
+
+template<typename T>
+detached run_blocking(task<T> &awaited, std::optional<T> *result, std::exception_ptr *exception,
+                      uthread_sem_t *done) {
+    try {
+        result->emplace(co_await awaited);
+    }
+    catch (...) {
+        *exception = std::current_exception();
+    }
+    uthread_sem_post(done);
+}
+
+inline detached run_blocking(task<void> &awaited, std::exception_ptr *exception, uthread_sem_t *done) {
+    try {
+        co_await awaited;
+    }
+    catch (...) {
+        *exception = std::current_exception();
+    }
+    uthread_sem_post(done);
+}
+
+} // namespace detail
+
+/**
+ * starts the threads that run tasks: the given number of carrier threads (as many as there are workers, to let
+ * tasks use every kernel thread), and a thread that wakes sleeping tasks. must be called once, from a thread, before
+ * tasks are used. either all the threads are started or none is, and it may then be called again.
+ * @return On success, return 0. On failure, return -1.
+ */
+inline int start_tasks(int carriers = 1) {
+    if (detail::the_executor != nullptr || carriers <= 0) {
+        std::cerr << "thread library error: Tasks already started or non-positive carriers sent to start_tasks\n";
+        return -1;
+    }
+
+    uthread_preempt_disable();
+    auto *e = new detail::executor();
+    e->lines = new detail::ready_line[carriers];
+    uthread_preempt_enable();
+    e->carriers = carriers;
+    uthread_sem_init(&e->work, 0);
+    uthread_sem_init(&e->timer, 0);
+    bool keyed = uthread_key_create(&e->line_key, nullptr) == 0;
+    detail::the_executor = e;
+
+    if (!keyed || uthread_spawn_n(detail::executor_thread, carriers + 1, nullptr) < 0) {
+        detail::the_executor = nullptr;
+        if (keyed)
+            uthread_key_delete(e->line_key);
+        uthread_sem_destroy(&e->work);
+        uthread_sem_destroy(&e->timer);
+        uthread_preempt_disable();
+        delete[] e->lines;
+        delete e;
+        uthread_preempt_enable();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * runs the task on the carriers, without waiting for it. an exception that leaves it terminates the process.
+ */
+inline void spawn(task<void> spawned) {
+    detail::run_detached(std::move(spawned)).start();
+}
+
+/**
+ * runs the task on the carriers, and waits for its result, which it returns (or for its exception, which it
+ * rethrows). must be called from a thread, not from a task.
+ */
+template<typename T>
+T block_on(task<T> awaited) {
+    uthread_sem_t done;
+    uthread_sem_init(&done, 0);
+    std::exception_ptr exception;
+    if constexpr (std::is_void_v<T>) {
+        detail::run_blocking(awaited, &exception, &done).start();
+        uthread_sem_wait(&done);
+        uthread_sem_destroy(&done);
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+    else {
+        std::optional<T> result;
+        detail::run_blocking(awaited, &result, &exception, &done).start();
+        uthread_sem_wait(&done);
+        uthread_sem_destroy(&done);
+        if (exception)
+            std::rethrow_exception(exception);
+        return std::move(*result);
+    }
+}
+
+/**
+ * co_await yield(): moves the task to the end of its carrier's ready line
+ */
+inline auto yield() {
+    struct awaiter {
+        detail::node waiter;
+
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> self) {
+            waiter.handle = self;
+            detail::schedule(&waiter);
+        }
+
+        void await_resume() noexcept {}
+    };
+    return awaiter{};
+}
+
+/**
+ * co_await sleep_for(usecs): suspends the task for usecs microseconds, measured on CLOCK_MONOTONIC
+ */
+inline auto sleep_for(long long usecs) {
+    struct awaiter {
+        long long usecs;
+        detail::node waiter;
+
+        bool await_ready() noexcept {
+            return usecs <= 0;
+        }
+
+        void await_suspend(std::coroutine_handle<> self) {
+            detail::executor *e = detail::the_executor;
+            waiter.handle = self;
+            uthread_preempt_disable();
+            e->timers_lock.lock();
+            e->timers.push_back({detail::now_nsecs() + usecs * 1000, &waiter});
+            std::push_heap(e->timers.begin(), e->timers.end(), detail::later);
+            bool earliest = e->timers.front().waiter == &waiter;
+            e->timers_lock.unlock();
+            uthread_preempt_enable();
+            if (earliest)
+                uthread_sem_post(&e->timer);
+        }
+
+        void await_resume() noexcept {}
+    };
+    return awaiter{usecs, {}};
+}
+
+namespace detail {
+
+/*
+ * a channel operation: carried out at once by the task if it can go ahead without waiting, and otherwise queued on
+ * the channel by uthread_chan_start, while the task is suspended. the library completes it by pushing the task to
+ * completed, and posting work for it.
+ */
+struct chan_awaiter : uthread_chan_async {
+    node waiter;
+
+    chan_awaiter(uthread_chan_t *chan, int kind, void *elem) : uthread_chan_async() {
+        op = {chan, kind, elem, 0};
+        complete = [](uthread_chan_async *async) {
+            push_completed(&static_cast<chan_awaiter *>(async)->waiter);
+        };
+        done = &the_executor->work;
+    }
+
+    bool await_ready() noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> self) {
+        waiter.handle = self;
+        int started = uthread_chan_start(this);
+        if (started == 1)
+            return true; // the task may be resumed by now, *this is not ours any more
+        result = started;
+        return false;
+    }
+
+    // a receive from a closed and drained channel returns -1, like uthread_chan_recv
+    int await_resume() noexcept {
+        return op.op == UTHREAD_CHAN_RECV && !op.ok ? -1 : result;
+    }
+};
+
+} // namespace detail
+
+/**
+ * co_await chan_send(chan, &elem): uthread_chan_send, suspending the task while it waits. returns what it returns.
+ */
+inline detail::chan_awaiter chan_send(uthread_chan_t *chan, const void *elem) {
+    return detail::chan_awaiter(chan, UTHREAD_CHAN_SEND, const_cast<void *>(elem));
+}
+
+/**
+ * co_await chan_recv(chan, &elem): uthread_chan_recv, suspending the task while it waits. returns what it returns.
+ */
+inline detail::chan_awaiter chan_recv(uthread_chan_t *chan, void *elem) {
+    return detail::chan_awaiter(chan, UTHREAD_CHAN_RECV, elem);
+}
+
+/**
+ * A mutex for tasks: a task that waits for it is suspended, not its carrier, and it may be unlocked from another
+ * carrier than the one that locked it. Waiting tasks get it in FIFO order, handed over by unlock. Its state is
+ * guarded by a spin lock, taken with preemption disabled, that is never held across a suspension.
+ */
+class task_mutex {
+public:
+    task_mutex() = default;
+
+    task_mutex(const task_mutex &) = delete;
+    task_mutex &operator=(const task_mutex &) = delete;
+
+    bool try_lock() {
+        uthread_preempt_disable();
+        guard.lock();
+        bool taken = !locked;
+        locked = true;
+        guard.unlock();
+        uthread_preempt_enable();
+        return taken;
+    }
+
+    /**
+     * co_await mutex.lock()
+     */
+    auto lock() {
+        struct awaiter {
+            task_mutex *mutex;
+            detail::node waiter;
+
+            bool await_ready() {
+                return mutex->try_lock();
+            }
+
+            bool await_suspend(std::coroutine_handle<> self) {
+                waiter.handle = self;
+                waiter.next = nullptr;
+                uthread_preempt_disable();
+                mutex->guard.lock();
+                bool queued = mutex->locked; // or unlocked since await_ready
+                if (queued) {
+                    if (mutex->tail != nullptr)
+                        mutex->tail->next = &waiter;
+                    else
+                        mutex->head = &waiter;
+                    mutex->tail = &waiter;
+                }
+                else {
+                    mutex->locked = true;
+                }
+                mutex->guard.unlock();
+                uthread_preempt_enable();
+                return queued;
+            }
+
+            void await_resume() noexcept {}
+        };
+        return awaiter{this, {}};
+    }
+
+    void unlock() {
+        uthread_preempt_disable();
+        guard.lock();
+        detail::node *next = head;
+        if (next != nullptr) {
+            // the mutex stays locked, for the task at the head
+            head = next->next;
+            if (head == nullptr)
+                tail = nullptr;
+        }
+        else {
+            locked = false;
+        }
+        guard.unlock();
+        uthread_preempt_enable();
+        if (next != nullptr)
+            detail::schedule(next);
+    }
+
+private:
+    SpinLock guard;
+    bool locked = false;
+    detail::node *head = nullptr;
+    detail::node *tail = nullptr;
+};
+
+} // namespace uthread
+
+#endif //OS_EX2_UTHREAD_TASK_H
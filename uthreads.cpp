@@ -1,7 +1,15 @@
 #include <cstdlib>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <new>
 #include "uthreads.h"
 #include "Scheduler.h"
+#include "Channel.h"
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
 
 
 typedef void (*thread_entry_point)(void);
@@ -9,16 +17,423 @@ typedef void (*thread_entry_point)(void);
 /* External interface */
 
 static Scheduler *scheduler;
-static struct sigaction sa = {0};
+static struct sigaction sa = {};
 
-static void timerHandler(int sig) {
-    scheduler->timerHandler(sig);
+/*
+ * critical sections replace masking SIGVTALRM: entering one is an increment of the running thread's depth, and a
+ * timer signal that arrives inside one is only recorded, to be acted upon by the leave_critical that ends it.
+ * the thread is looked up afresh each time: a thread may resume on another worker after any switch.
+ */
+static inline void enter_critical() {
+    Thread *self = Worker::currentThread();
+    self->setCriticalDepth(self->getCriticalDepth() + 1);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+static void leave_critical() {
+    Thread *self = Worker::currentThread();
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    self->setCriticalDepth(self->getCriticalDepth() - 1);
+    if (self->getCriticalDepth() != 0)
+        return;
+
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    while (Worker::isPreemptionPending()) {
+        // carry out the preemption from inside a critical section of its own, like the signal handler does
+        self->setCriticalDepth(1);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        scheduler->timerHandler(SIGVTALRM);
+        self->setCriticalDepth(0);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+}
+
+/*
+ * library calls that use the scheduler's state run in a critical section, holding the scheduler's lock. the calls
+ * that only touch the ready queues (uthread_yield) and the timer need no more than the critical section.
+ */
+static inline void enter_scheduler() {
+    enter_critical();
+    Scheduler::lock();
+    // a thread terminated while it ran on another worker goes no further, or it could still take an element off a
+    // channel, say, after uthread_terminate returned
+    Thread *self = Worker::currentThread();
+    if (self->getRequest() == TERMINATE_REQUESTED)
+        scheduler->terminateThread(self);
+}
+
+static inline void leave_scheduler() {
+    Scheduler::unlock();
+    leave_critical();
+}
+
+/*
+ * the uthread-local keys: a key is in use while its sequence number is odd. creating and deleting a key both bump
+ * it, so the values threads set for a deleted key never match the key that reuses its index (see SpecificValue).
+ */
+struct KeySlot {
+    std::atomic<unsigned> seq;
+    void (*destructor)(void *);
+};
+
+static KeySlot keys[UTHREAD_KEYS_MAX];
+
+/*
+ * calls the destructors of the calling thread's values, before it terminates itself
+ */
+static void destroy_own_specific() {
+    SpecificValue *specific = Worker::currentThread()->getSpecific();
+    if (specific == nullptr)
+        return;
+
+    for (int pass = 0; pass < UTHREAD_DESTRUCTOR_ITERATIONS; ++pass) {
+        bool called = false;
+        for (unsigned key = 0; key < UTHREAD_KEYS_MAX; ++key) {
+            void (*destructor)(void *) = keys[key].destructor;
+            if (specific[key].seq != keys[key].seq.load(std::memory_order_acquire) ||
+                    specific[key].value == nullptr || destructor == nullptr)
+                continue;
+            void *value = specific[key].value;
+            specific[key].value = nullptr;
+            destructor(value);
+            called = true;
+        }
+        if (!called)
+            return;
+    }
+}
+
+/*
+ * calls the destructors of the values taken from a thread another thread terminated, and deletes them
+ */
+static void destroy_specific(SpecificValue *specific) {
+    if (specific == nullptr)
+        return;
+
+    for (unsigned key = 0; key < UTHREAD_KEYS_MAX; ++key) {
+        void (*destructor)(void *) = keys[key].destructor;
+        if (specific[key].seq == keys[key].seq.load(std::memory_order_acquire) && specific[key].value != nullptr &&
+                destructor != nullptr)
+            destructor(specific[key].value);
+    }
+    delete[] specific;
+}
+
+enum MutexState {MUTEX_UNLOCKED, MUTEX_LOCKED, MUTEX_CONTENDED};
+
+static inline int atomic_load(const int *value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+static inline bool atomic_cas(int *value, int expected, int desired) {
+    return __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * gives the mutex to the waiter's thread if it is unlocked, or queues the waiter for it otherwise. called in the
+ * scheduler, so the mutex can only be taken by the lock fast path (and released by the unlock fast path, while it
+ * has no waiters) meanwhile.
+ * @return true if the waiter's thread got the mutex
+ */
+static bool acquire_or_queue(uthread_mutex_t *mutex, Waiter *waiter) {
+    for (;;) {
+        int state = atomic_load(&mutex->state);
+        if (state == MUTEX_UNLOCKED) {
+            if (atomic_cas(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED)) {
+                __atomic_store_n(&mutex->owner, waiter->thread->getId(), __ATOMIC_RELAXED);
+                return true;
+            }
+        }
+        else if (state == MUTEX_CONTENDED || atomic_cas(&mutex->state, MUTEX_LOCKED, MUTEX_CONTENDED)) {
+            // the owner's unlock now has to enter the scheduler, and finds us in the queue
+            WaitQueue(&mutex->waiters).pushBack(waiter);
+            return false;
+        }
+    }
+}
+
+/*
+ * unlocks the mutex, handing it over to the first thread waiting for it if there is one. called in the scheduler.
+ * @return the thread that got the mutex, nullptr if none
+ */
+static Thread *release_mutex(uthread_mutex_t *mutex) {
+    WaitQueue waiters(&mutex->waiters);
+    Waiter *next = waiters.popFront();
+    if (next == nullptr) {
+        __atomic_store_n(&mutex->owner, -1, __ATOMIC_RELAXED);
+        __atomic_store_n(&mutex->state, MUTEX_UNLOCKED, __ATOMIC_RELEASE);
+        return nullptr;
+    }
+
+    __atomic_store_n(&mutex->owner, next->thread->getId(), __ATOMIC_RELAXED);
+    if (waiters.empty())
+        __atomic_store_n(&mutex->state, MUTEX_LOCKED, __ATOMIC_RELEASE);
+    scheduler->wakeWaiter(next);
+    return next->thread;
+}
+
+/*
+ * moves a thread signaled on a condition variable over to the mutex it waited with: it keeps waiting, for the mutex
+ * now, unless it gets it right away. called in the scheduler.
+ */
+static void signal_waiter(Waiter *waiter) {
+    scheduler->cancelTimeout(waiter->thread);
+    if (acquire_or_queue((uthread_mutex_t *) waiter->object, waiter))
+        scheduler->wakeWaiter(waiter);
+}
+
+/*
+ * the CLOCK_MONOTONIC time (in nanoseconds) usecs microseconds from now, for the timed waits.
+ * a negative usecs times out at once.
+ */
+static long long deadline_after(long long usecs) {
+    long long now = clockNsecs(CLOCK_MONOTONIC);
+    if (usecs <= 0)
+        return now;
+    return usecs > (LLONG_MAX - now) / 1000 ? LLONG_MAX : now + usecs * 1000;
+}
+
+/*
+ * uthread_mutex_lock, timing out at the given deadline if it is not 0
+ * @return 0 once the mutex is locked, 1 if the deadline passed first, -1 on failure
+ */
+static int lock_mutex(uthread_mutex_t *mutex, long long deadline, const char *caller) {
+    if (!mutex) {
+        std::cerr << "thread library error: Null mutex sent to " << caller << " function\n";
+        return -1;
+    }
+    Thread *self = Worker::currentThread();
+    if (atomic_cas(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED)) {
+        __atomic_store_n(&mutex->owner, self->getId(), __ATOMIC_RELAXED);
+        return 0;
+    }
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == self->getId()) {
+        std::cerr << "thread library error: Mutex held by the calling thread sent to " << caller << " function\n";
+        return -1;
+    }
+
+    enter_scheduler();
+    Waiter waiter(self);
+    if (!acquire_or_queue(mutex, &waiter))
+        scheduler->waitCurrentThread(&waiter, nullptr, deadline); // whoever wakes us up has made us the owner
+    leave_scheduler();
+    return waiter.timed_out ? 1 : 0;
+}
+
+/*
+ * the timeout of a uthread_cond_timedwait: the thread stops waiting for a signal, but still has to lock the
+ * mutex again before it returns
+ */
+static void expire_cond_wait(Waiter *waiter) {
+    WaitQueue::remove(waiter);
+    signal_waiter(waiter);
+}
+
+/*
+ * uthread_cond_wait, timing out at the given deadline if it is not 0
+ * @return 0 once signaled, 1 if the deadline passed first (the mutex is locked again either way), -1 on failure
+ */
+static int wait_cond(uthread_cond_t *cond, uthread_mutex_t *mutex, long long deadline, const char *caller) {
+    if (!cond || !mutex || __atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != Worker::currentThread()->getId()) {
+        std::cerr << "thread library error: Null condition variable or mutex not held by the calling thread sent "
+                     "to " << caller << " function\n";
+        return -1;
+    }
+
+    enter_scheduler();
+    Waiter waiter(Worker::currentThread(), mutex);
+    waiter.expire = expire_cond_wait;
+    WaitQueue(&cond->waiters).pushBack(&waiter);
+    Thread *woken = release_mutex(mutex);
+    // the signal moves us over to the mutex, so we only wake up once we hold it again
+    scheduler->waitCurrentThread(&waiter, woken, deadline);
+    leave_scheduler();
+    return waiter.timed_out ? 1 : 0;
+}
+
+/*
+ * uthread_sem_wait, timing out at the given deadline if it is not 0
+ * @return 0 once the semaphore is decremented, 1 if the deadline passed first, -1 on failure
+ */
+static int wait_sem(uthread_sem_t *sem, long long deadline, const char *caller) {
+    if (!sem) {
+        std::cerr << "thread library error: Null semaphore sent to " << caller << " function\n";
+        return -1;
+    }
+    if (uthread_sem_trywait(sem) == 0)
+        return 0;
+
+    enter_scheduler();
+    // a negative value counts the waiting threads, and it is only decremented below 0 in the scheduler, so a post
+    // that sees it negative finds us in the queue. a thread that stops waiting (timed out or terminated) is still
+    // counted, and the post that finds no one to wake gives its unit back.
+    if (__atomic_fetch_sub(&sem->value, 1, __ATOMIC_ACQ_REL) > 0) {
+        leave_scheduler();
+        return 0;
+    }
+    Waiter waiter(Worker::currentThread());
+    WaitQueue(&sem->waiters).pushBack(&waiter);
+    scheduler->waitCurrentThread(&waiter, nullptr, deadline); // the post that wakes us up gives us its unit
+    leave_scheduler();
+    return waiter.timed_out ? 1 : 0;
+}
+
+/*
+ * wakes the first thread waiting for the semaphore, whose post found the value negative, in the scheduler
+ */
+static void wake_sem_waiter(uthread_sem_t *sem) {
+    Waiter *waiter = WaitQueue(&sem->waiters).popFront();
+    if (waiter != nullptr)
+        scheduler->wakeWaiter(waiter);
+    else // the waiter it was meant for was terminated while waiting, the unit stays
+        __atomic_fetch_add(&sem->value, 1, __ATOMIC_ACQ_REL);
+}
+
+#define SELECT_LOCAL_WAITERS 4 /* uthread_chan_select cases whose waiters are kept on the caller's stack */
+
+/*
+ * the scheduler's view of a uthread_chan_t
+ */
+struct uthread_chan : Channel {
+    using Channel::Channel;
+};
+
+static unsigned select_seed = 1; // picks the case uthread_chan_select tries first. only used in the scheduler
+
+/*
+ * uthread_chan_send, timing out at the given deadline if it is not 0
+ * @return 0 once the element is sent, 1 if the deadline passed first, -1 on failure
+ */
+static int send_chan(uthread_chan_t *chan, const void *elem, long long deadline, const char *caller) {
+    if (!chan || !elem) {
+        std::cerr << "thread library error: Null channel or element sent to " << caller << " function\n";
+        return -1;
+    }
+
+    enter_scheduler();
+    Thread *woken;
+    bool timed_out = false;
+    Channel::Result result = chan->trySend(elem, &woken);
+    if (result == Channel::WOULD_BLOCK) {
+        ChanWaiter waiter(Worker::currentThread(), (void *) elem);
+        chan->addSender(&waiter);
+        scheduler->waitCurrentThread(&waiter, nullptr, deadline);
+        timed_out = waiter.timed_out;
+        result = waiter.ok || timed_out ? Channel::DONE : Channel::CLOSED;
+    }
+    else if (woken != nullptr && chan->getCapacity() == 0)
+        scheduler->switchToThread(woken);
+    leave_scheduler();
+
+    if (result == Channel::CLOSED) {
+        std::cerr << "thread library error: Closed channel sent to " << caller << " function\n";
+        return -1;
+    }
+    return timed_out ? 1 : 0;
+}
+
+/*
+ * uthread_chan_recv, timing out at the given deadline if it is not 0
+ * @return 0 once an element is received, 1 if the deadline passed first, -1 if the channel is closed and drained
+ * or on failure
+ */
+static int recv_chan(uthread_chan_t *chan, void *elem, long long deadline, const char *caller) {
+    if (!chan || !elem) {
+        std::cerr << "thread library error: Null channel or element sent to " << caller << " function\n";
+        return -1;
+    }
+
+    enter_scheduler();
+    Channel::Result result = chan->tryRecv(elem);
+    if (result == Channel::WOULD_BLOCK) {
+        ChanWaiter waiter(Worker::currentThread(), elem);
+        chan->addReceiver(&waiter);
+        scheduler->waitCurrentThread(&waiter, nullptr, deadline);
+        if (waiter.timed_out) {
+            leave_scheduler();
+            return 1;
+        }
+        result = waiter.ok ? Channel::DONE : Channel::CLOSED;
+    }
+    leave_scheduler();
+    return result == Channel::DONE ? 0 : -1;
+}
+
+static_assert(sizeof(ChanWaiter) <= sizeof(uthread_chan_async::waiter), "uthread_chan_async has no room for a waiter");
+
+/*
+ * ends an operation uthread_chan_start queued, in the library call that carried it out
+ */
+static void complete_async(ChanWaiter *waiter) {
+    auto *async = (uthread_chan_async *) ((char *) waiter - offsetof(uthread_chan_async, waiter));
+    if (async->op.op == UTHREAD_CHAN_RECV) {
+        async->op.ok = waiter->ok;
+        async->result = 0;
+    }
+    else
+        async->result = waiter->ok ? 0 : -1;
+    uthread_sem_t *done = async->done; // async may be gone once complete returns
+    async->complete(async);
+    if (done != nullptr && __atomic_fetch_add(&done->value, 1, __ATOMIC_ACQ_REL) < 0)
+        wake_sem_waiter(done);
+}
+
+/*
+ * errno, for the I/O calls. a thread may resume on another kernel thread while it waits for its fd, so errno
+ * (whose address is per kernel thread) is only accessed out of line, where the compiler cannot reuse an address
+ * it computed before the wait.
+ */
+__attribute__((noinline)) static int io_errno() {
+    return errno;
+}
+
+__attribute__((noinline)) static void set_io_errno(int error) {
+    errno = error;
+}
+
+/*
+ * true if the I/O call that just failed would have blocked, or was interrupted, and should be retried
+ */
+static bool io_would_block() {
+    int error = io_errno();
+    return error == EAGAIN || error == EWOULDBLOCK || error == EINTR;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || (flags & O_NONBLOCK))
+        return flags;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/*
+ * suspends the calling thread until the fd becomes readable (or writable)
+ * @return 0 once it is, or -1 if the fd cannot be polled
+ */
+static int wait_for_fd(int fd, bool write) {
+    enter_scheduler();
+    Waiter waiter(Worker::currentThread());
+    bool waited = scheduler->waitForFd(fd, write, &waiter);
+    leave_scheduler();
+    return waited ? 0 : -1;
 }
 
-static void manage_signal(int action) {
-    sigset_t  temp = {0};
-    sigaddset(&temp, SIGVTALRM);
-    sigprocmask(action, &temp, nullptr);
+static void timerHandler(int sig) {
+    Thread *self = Worker::currentThread();
+    if (self == nullptr) // not one of our kernel threads
+        return;
+
+    if (self->getCriticalDepth() != 0) {
+        Worker::setPreemptionPending(true);
+        return;
+    }
+
+    int saved_errno = errno;
+    self->setCriticalDepth(1);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    scheduler->timerHandler(sig);
+    leave_critical();
+    errno = saved_errno;
 }
 
 /**
@@ -34,21 +449,106 @@ static void manage_signal(int action) {
  * @return On success, return 0. On failure, return -1.
 */
 int uthread_init(int quantum_usecs){
+    uthread_config config = {};
+    config.quantum_usecs = quantum_usecs;
+    return uthread_init_config(&config);
+}
+
+/**
+ * @brief initializes the thread library with the given settings.
+ *
+ * Behaves exactly like uthread_init(config->quantum_usecs), except that the limit on the number of concurrent
+ * threads is config->max_threads instead of MAX_THREAD_NUM. Call either this function or uthread_init, once.
+ * It is an error to pass a non-positive quantum_usecs (unless manual_ticks is set) or a negative max_threads or
+ * workers.
+ *
+ * With config->workers > 1 the threads are scheduled M:N: the calling kernel thread and workers - 1 new kernel
+ * threads each run threads from a ready queue of their own, preempt them with a timer on their own CPU time, and
+ * take threads from the longest ready queue when their own runs dry. A thread may move between kernel threads
+ * whenever it is switched out. The API keeps its meaning with these differences:
+ * - Blocking or terminating a thread that is RUNNING on another kernel thread takes effect as soon as that kernel
+ *   thread can be interrupted, shortly after the call returns.
+ * - Quantums are counted over all kernel threads together.
+ * - uthread_terminate(0) exits without releasing the library's memory.
+ * - errno is kept per thread, but a thread must not keep the address of errno across a call that may switch.
+ *
+ * With config->policy == UTHREAD_POLICY_MLFQ the READY threads are kept at mlfq_levels priority levels instead of
+ * in a single line, and the next thread to run is the first in line at the highest level that has any:
+ * - Every thread starts at the highest level, 0.
+ * - A thread that is preempted at the end of its quantum drops one level (down to the lowest).
+ * - A thread that blocks, sleeps, yields or is blocked before its quantum ends keeps its level.
+ * - The quantum of a thread at level n is quantum_usecs * 2^n.
+ * - Every mlfq_boost_quantums quantums all threads go back to level 0, so that threads at low levels do not
+ *   starve.
+ * A thread that yields only hands over to READY threads at its own level or above.
+ * It is an error to pass an unknown policy, negative MLFQ settings or more than MLFQ_MAX_LEVELS levels.
+ *
+ * With config->tickless set, a kernel thread only keeps its timer running while there is something to preempt
+ * for: READY threads, threads sleeping with uthread_sleep, or threads waiting for fds. Otherwise the timer is
+ * off, or set to go off once at the next deadline of uthread_sleep_usec or of a timed wait, and a thread that
+ * runs alone is not interrupted and counts no new quantums. While it runs, the timer ticks every quantum_usecs
+ * and is not set again on every switch, so a quantum of a thread lasts between 1 and 2 times its length.
+ *
+ * With config->trace_events > 0 every kernel thread records what the scheduler does on it in a ring of its last
+ * trace_events events (rounded up to a power of 2), see uthread_trace_dump. It is an error to pass a negative
+ * trace_events.
+ *
+ * With config->manual_ticks set, no timer is armed and quantums only end by calls to uthread_tick: a quantum lasts
+ * quantum_ticks calls (quantum_ticks * 2^n at MLFQ level n), and quantum_usecs is not used. Threads are then only
+ * switched at ticks and at the library calls that give up the CPU, so a program that does not depend on the clock
+ * (uthread_sleep_usec, timed waits, fds) runs the exact same schedule every time. It is an error to set manual_ticks
+ * together with tickless or more than one worker, or to pass a negative quantum_ticks.
+ *
+ * Every thread stack sits above a PROT_NONE guard page, so a thread that overflows its stack faults right away. Each
+ * thread then takes two of the process's memory mappings, which limits the number of threads to about half of
+ * vm.max_map_count (65530 by default). With config->no_guard_pages set, the pages below the stacks are left
+ * unprotected, so there is no such limit: an overflow of less than a page is only caught when the thread is deleted
+ * (and the process exits), and a larger one may overwrite the stack below it.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_config(const uthread_config *config){
     /*
      * course of actions:
      * we add the main (current) thread to a static something who can manage a line
      * and set an alarm, so it'll automatically will use the handler after quantum time.
      *
      */
-    manage_signal(SIG_BLOCK);
-
-    if (quantum_usecs <= 0) {
+    if (config->quantum_usecs <= 0 && !config->manual_ticks) {
         std::cerr << "thread library error: Non-positive value sent to uthread_init function\n";
-        manage_signal(SIG_UNBLOCK);
         return -1;
     }
 
+    if (config->max_threads < 0 || config->workers < 0 || config->trace_events < 0 || config->quantum_ticks < 0) {
+        std::cerr << "thread library error: Negative value sent to uthread_init_config function\n";
+        return -1;
+    }
+    int max_threads = config->max_threads ? config->max_threads : MAX_THREAD_NUM;
+    int workers = config->workers ? config->workers : 1;
+
+    if ((config->policy != UTHREAD_POLICY_RR && config->policy != UTHREAD_POLICY_MLFQ) ||
+            config->mlfq_levels < 0 || config->mlfq_levels > MLFQ_MAX_LEVELS || config->mlfq_boost_quantums < 0) {
+        std::cerr << "thread library error: Invalid scheduling policy sent to uthread_init_config function\n";
+        return -1;
+    }
+    if (config->manual_ticks && (config->tickless || workers > 1)) {
+        std::cerr << "thread library error: Manual ticks sent to uthread_init_config function with tickless mode or "
+                     "several workers\n";
+        return -1;
+    }
+    int manual_ticks = 0;
+    if (config->manual_ticks)
+        manual_ticks = config->quantum_ticks ? config->quantum_ticks : 1;
+
+    int levels = 1, boost_period = 0;
+    if (config->policy == UTHREAD_POLICY_MLFQ) {
+        levels = config->mlfq_levels ? config->mlfq_levels : MLFQ_LEVELS;
+        boost_period = config->mlfq_boost_quantums ? config->mlfq_boost_quantums : MLFQ_BOOST_QUANTUMS;
+    }
+
     // Install timer_handler as the signal handler for SIGVTALRM.
+    // SA_NODEFER: the signal is never masked, a signal that arrives while the handler runs finds the handler's own
+    // critical section and is deferred like any other.
     sa.sa_handler = timerHandler;
     sa.sa_flags = SA_NODEFER;
     if (sigaction(SIGVTALRM, &sa, nullptr) < 0) {
@@ -56,8 +556,15 @@ int uthread_init(int quantum_usecs){
         exit(1);
     }
 
-    scheduler = new Scheduler(quantum_usecs, sa);
-    manage_signal(SIG_UNBLOCK);
+    if (config->no_guard_pages)
+        Thread::dropGuardPages();
+
+    // the main thread starts out inside a critical section, so the timer cannot preempt it before we are done
+    scheduler = new Scheduler(config->quantum_usecs, max_threads, workers, levels, boost_period,
+                              config->collect_stats != 0, config->tickless != 0, manual_ticks, config->trace_events,
+                              sa);
+    scheduler->startWorkers();
+    leave_critical();
     return 0;
 }
 
@@ -67,9 +574,10 @@ int uthread_init(int quantum_usecs){
  *
  * The thread is added to the end of the READY threads list.
  * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
- * limit (MAX_THREAD_NUM).
+ * limit (MAX_THREAD_NUM, or the max_threads given to uthread_init_config).
  * Each thread should be allocated with a stack of size STACK_SIZE bytes.
- * It is an error to call this function with a null entry_point.
+ * It is an error to call this function with a null entry_point. It fails as well if no memory could be mapped for
+ * the stack.
  *
  * @return On success, return the ID of the created thread. On failure, return -1.
 */
@@ -82,22 +590,109 @@ int uthread_spawn(thread_entry_point entry_point){
      * note that the os alocate an id to each thread, that is NOT the id we will return,
      * but rather an id we generate using OUR genius code.
      */
-    manage_signal(SIG_BLOCK);
+    enter_scheduler();
     if (!entry_point) {
         std::cerr << "thread library error: Null entry point sent to uthread_spawn function\n";
-        manage_signal(SIG_UNBLOCK);
+        leave_scheduler();
+        return -1;
+    }
+    if (!scheduler->canAddThread()) {
+        std::cerr << "thread library error: Maximum number of threads reached ("
+                        + std::to_string(scheduler->getMaxThreads()) + ")\n";
+        leave_scheduler();
         return -1;
     }
     auto * new_thread = new Thread(entry_point);
-    if (!scheduler->addNewThread(new_thread)) {
+    if (!new_thread->hasStack()) {
+        delete new_thread;
+        std::cerr << "thread library error: Failed to allocate a stack in uthread_spawn function\n";
+        leave_scheduler();
+        return -1;
+    }
+    int tid = scheduler->addNewThread(new_thread);
+
+    leave_scheduler();
+    return tid;
+}
+
+
+/**
+ * @brief Creates a new thread that runs start_routine(arg), and can be joined with uthread_join.
+ *
+ * The thread is created like by uthread_spawn, and when start_routine returns the thread terminates. Until some
+ * thread joins it (or it is detached with uthread_detach), a terminated thread remains a zombie: it keeps its ID,
+ * counts towards the thread limit, and keeps what start_routine returned (NULL if it was terminated by
+ * uthread_terminate). Library calls on a zombie other than uthread_join and uthread_detach fail as if no
+ * thread with its ID existed.
+ * It is an error to call this function with a null start_routine.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_arg(void *(*start_routine)(void *), void *arg) {
+    enter_scheduler();
+    if (!start_routine) {
+        std::cerr << "thread library error: Null start routine sent to uthread_spawn_arg function\n";
+        leave_scheduler();
+        return -1;
+    }
+    if (!scheduler->canAddThread()) {
+        std::cerr << "thread library error: Maximum number of threads reached ("
+                        + std::to_string(scheduler->getMaxThreads()) + ")\n";
+        leave_scheduler();
+        return -1;
+    }
+    auto *new_thread = new Thread(start_routine, arg);
+    if (!new_thread->hasStack()) {
+        delete new_thread;
+        std::cerr << "thread library error: Failed to allocate a stack in uthread_spawn_arg function\n";
+        leave_scheduler();
+        return -1;
+    }
+    int tid = scheduler->addNewThread(new_thread);
+
+    leave_scheduler();
+    return tid;
+}
+
+
+/**
+ * @brief Creates count threads, all with the entry point entry_point, and stores their IDs in tids (unless it is
+ * NULL).
+ *
+ * Behaves like count calls to uthread_spawn, made in a single visit to the scheduler, which sets up the room for the
+ * threads and their stacks at once. The threads are added to the end of the READY threads list in order. Either all
+ * of them are created or none is: it is an error if they would exceed the thread limit, and to call this function
+ * with a null entry_point or a non-positive count. It fails as well if no memory could be mapped for the stacks.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_spawn_n(thread_entry_point entry_point, int count, int *tids) {
+    enter_scheduler();
+    if (!entry_point || count <= 0) {
+        std::cerr << "thread library error: Null entry point or non-positive count sent to uthread_spawn_n "
+                     "function\n";
+        leave_scheduler();
+        return -1;
+    }
+    if (!scheduler->canAddThread(count)) {
         std::cerr << "thread library error: Maximum number of threads reached ("
-                        + std::to_string(MAX_THREAD_NUM) + ")\n";
-        manage_signal(SIG_UNBLOCK);
+                        + std::to_string(scheduler->getMaxThreads()) + ")\n";
+        leave_scheduler();
+        return -1;
+    }
+    if (!scheduler->reserveThreads(count)) {
+        std::cerr << "thread library error: Failed to allocate stacks in uthread_spawn_n function\n";
+        leave_scheduler();
         return -1;
     }
 
-    manage_signal(SIG_UNBLOCK);
-    return new_thread->getId();
+    for (int i = 0; i < count; ++i) {
+        int tid = scheduler->addNewThread(new Thread(entry_point));
+        if (tids)
+            tids[i] = tid;
+    }
+    leave_scheduler();
+    return 0;
 }
 
 
@@ -112,23 +707,113 @@ int uthread_spawn(thread_entry_point entry_point){
  * itself or the main thread is terminated, the function does not return.
 */
 int uthread_terminate(int tid) {
-    //the timer signal should be blocked in case the terminated thread is next inline
-    manage_signal(SIG_BLOCK);
+    //the timer signal should be deferred in case the terminated thread is next inline
+    enter_scheduler();
 
     if (tid == 0) {
-        delete scheduler;
+        // other workers may be running threads right now, so with M:N scheduling their memory is left to exit
+        if (!Scheduler::isMulticore())
+            delete scheduler;
         exit(0);
     }
 
     Thread *thread = scheduler->getThreadByID(tid);
-    if (!thread) {
+    if (!thread || thread->getState() == TERMINATED) {
         std::cerr << "thread library error: Invalid thread ID sent to uthread_terminate function\n";
-        manage_signal(SIG_UNBLOCK);
+        leave_scheduler();
+        return -1;
+    }
+
+    SpecificValue *specific = nullptr;
+    if (thread == scheduler->getCurrentThread()) {
+        // the destructors run in the thread itself, outside the scheduler
+        leave_scheduler();
+        destroy_own_specific();
+        enter_scheduler();
+    }
+    // (a thread running on another worker may still be using its values, they are deleted with it)
+    scheduler->terminateThread(thread, &specific);
+    leave_scheduler();
+    destroy_specific(specific);
+    return 0;
+}
+
+
+/**
+ * @brief Waits for the thread with ID tid to terminate, and releases it.
+ *
+ * The calling thread waits (without using quantums) until the thread terminates, unless it already did. If result
+ * is not NULL, what the thread's start routine returned is stored in *result (NULL for a thread created by
+ * uthread_spawn, or terminated by uthread_terminate). Any thread may be joined, while it exists, but only a thread
+ * created by uthread_spawn_arg can be joined after it terminated.
+ * If no thread with ID tid exists it is considered an error. It is also an error to join the main thread
+ * (tid == 0), the calling thread itself, or a thread that another thread is already joining.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_join(int tid, void **result) {
+    enter_scheduler();
+    if (tid == 0) {
+        std::cerr << "thread library error: Main thread ID was sent to uthread_join function\n";
+        leave_scheduler();
+        return -1;
+    }
+
+    Thread *self = scheduler->getCurrentThread();
+    Thread *thread = scheduler->getThreadByID(tid);
+    if (!thread || thread == self) {
+        std::cerr << "thread library error: Invalid thread ID sent to uthread_join function\n";
+        leave_scheduler();
+        return -1;
+    }
+    WaitQueue joiners(thread->getJoiners());
+    if (!joiners.empty()) {
+        std::cerr << "thread library error: Thread already being joined sent to uthread_join function\n";
+        leave_scheduler();
+        return -1;
+    }
+
+    if (thread->getState() != TERMINATED) {
+        Waiter waiter(self, thread);
+        joiners.pushBack(&waiter);
+        scheduler->waitCurrentThread(&waiter); // it stays a zombie until we release it
+    }
+    if (result)
+        *result = thread->getResult();
+    scheduler->reapThread(thread);
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Makes the thread with ID tid release its resources as soon as it terminates, without being joined.
+ *
+ * Detaching a zombie (see uthread_spawn_arg) releases it right away. Detaching a thread created by uthread_spawn
+ * has no effect. If no thread with ID tid exists it is considered an error, and so is detaching a thread that
+ * another thread is joining.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_detach(int tid) {
+    enter_scheduler();
+    Thread *thread = scheduler->getThreadByID(tid);
+    if (!thread) {
+        std::cerr << "thread library error: Invalid thread ID sent to uthread_detach function\n";
+        leave_scheduler();
+        return -1;
+    }
+    if (!WaitQueue(thread->getJoiners()).empty()) {
+        std::cerr << "thread library error: Thread being joined sent to uthread_detach function\n";
+        leave_scheduler();
         return -1;
     }
 
-    scheduler->terminateThread(thread);
-    manage_signal(SIG_UNBLOCK);
+    if (thread->getState() == TERMINATED)
+        scheduler->reapThread(thread);
+    else
+        thread->setJoinable(false);
+    leave_scheduler();
     return 0;
 }
 
@@ -143,25 +828,67 @@ int uthread_terminate(int tid) {
  * @return On success, return 0. On failure, return -1.
 */
 int uthread_block(int tid) {
-    manage_signal(SIG_BLOCK);
-    //timer signal should be blocked in case the blocked thread is next in line
+    enter_scheduler();
+    //timer signal should be deferred in case the blocked thread is next in line
     // (but ot if the blocked thread is the current, think why)
 
     if (tid == 0){
         std::cerr << "thread library error: Main thread ID was sent to uthread_block function\n";
-        manage_signal(SIG_UNBLOCK);
+        leave_scheduler();
         return -1;
     }
 
     Thread *thread = scheduler->getThreadByID(tid);
     if (!thread || thread->getState() == TERMINATED) {
         std::cerr << "thread library error: Invalid thread ID sent to uthread_block function\n";
-        manage_signal(SIG_UNBLOCK);
+        leave_scheduler();
         return -1;
     }
 
     scheduler->blockThread(thread);
-    manage_signal(SIG_UNBLOCK);
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Blocks the threads whose IDs are the count first elements of tids, like uthread_block does each one.
+ *
+ * The threads are blocked in a single visit to the scheduler. If the calling thread is one of them it is blocked
+ * last, after the others. Either all of the threads are blocked or none is: it is an error if one of the IDs is the
+ * main thread's (0) or is not the ID of an existing thread, and to pass a null tids or a negative count.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_block_many(const int *tids, int count) {
+    if (!tids || count < 0) {
+        std::cerr << "thread library error: Null thread IDs or negative count sent to uthread_block_many function\n";
+        return -1;
+    }
+
+    enter_scheduler();
+    for (int i = 0; i < count; ++i) {
+        Thread *thread = scheduler->getThreadByID(tids[i]);
+        if (tids[i] == 0 || !thread || thread->getState() == TERMINATED) {
+            std::cerr << "thread library error: Invalid thread ID sent to uthread_block_many function\n";
+            leave_scheduler();
+            return -1;
+        }
+    }
+
+    // blocking ourselves switches away, so we go last
+    Thread *self = scheduler->getCurrentThread();
+    bool block_self = false;
+    for (int i = 0; i < count; ++i) {
+        Thread *thread = scheduler->getThreadByID(tids[i]);
+        if (thread == self)
+            block_self = true;
+        else
+            scheduler->blockThread(thread);
+    }
+    if (block_self)
+        scheduler->blockThread(self);
+    leave_scheduler();
     return 0;
 }
 
@@ -175,16 +902,76 @@ int uthread_block(int tid) {
  * @return On success, return 0. On failure, return -1.
 */
 int uthread_resume(int tid) {
-    manage_signal(SIG_BLOCK);
+    enter_scheduler();
     Thread *thread = scheduler->getThreadByID(tid);
     if (!thread || thread->getState() == TERMINATED) {
         std::cerr << "thread library error: Invalid thread ID sent to uthread_resume function\n";
-        manage_signal(SIG_UNBLOCK);
+        leave_scheduler();
         return -1;
     }
 
     scheduler->unblockThread(thread);
-    manage_signal(SIG_UNBLOCK);
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Resumes the threads whose IDs are the count first elements of tids, like uthread_resume does each one.
+ *
+ * The threads are resumed in a single visit to the scheduler, and added to the end of the READY threads list in
+ * order. Either all of the threads are resumed or none is: it is an error if one of the IDs is not the ID of an
+ * existing thread, and to pass a null tids or a negative count.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_resume_many(const int *tids, int count) {
+    if (!tids || count < 0) {
+        std::cerr << "thread library error: Null thread IDs or negative count sent to uthread_resume_many "
+                     "function\n";
+        return -1;
+    }
+
+    enter_scheduler();
+    for (int i = 0; i < count; ++i) {
+        Thread *thread = scheduler->getThreadByID(tids[i]);
+        if (!thread || thread->getState() == TERMINATED) {
+            std::cerr << "thread library error: Invalid thread ID sent to uthread_resume_many function\n";
+            leave_scheduler();
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < count; ++i)
+        scheduler->unblockThread(scheduler->getThreadByID(tids[i]));
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Resumes the thread with ID tid like uthread_resume does, from any kernel thread.
+ *
+ * Unlike the rest of the library, it may be called from kernel threads that do not run threads (helper pthreads
+ * that completed work on behalf of a thread) and from signal handlers: it takes no lock and is async-signal-safe.
+ * The resume is posted to an inbox, and carried out at the next scheduling decision, which an idle kernel thread of
+ * the library is woken to make. As with uthread_resume, the resume has no effect if the thread is not BLOCKED by
+ * then. Posting a resume for a thread whose posted resume is still pending has no further effect. The resume is
+ * meant for the thread that has the ID when it is posted: it is dropped if that thread terminated by the time the
+ * resume is carried out, even if a new thread was given the ID since.
+ * It is an error to pass an ID that cannot be a thread's (negative, or not below the maximal number of threads),
+ * and to call it before uthread_init. Nothing is printed on errors, printing is not async-signal-safe.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_post_resume(int tid) {
+    // no critical section and no lock: the caller may not be a thread at all
+    if (scheduler == nullptr || tid < 0 || tid >= scheduler->getMaxThreads())
+        return -1;
+
+    int saved_errno = errno;
+    scheduler->postResume(tid);
+    errno = saved_errno;
     return 0;
 }
 
@@ -203,69 +990,1002 @@ int uthread_resume(int tid) {
  * @return On success, return 0. On failure, return -1.
 */
 int uthread_sleep(int num_quantums) {
-    manage_signal(SIG_BLOCK);
-    //timer signal should be blocked in case it will pop out in the middle of running this function and the
+    enter_scheduler();
+    //timer signal should be deferred in case it will pop out in the middle of running this function and the
     // slipping quantum amount will be disrupted
     Thread *thread = scheduler->getCurrentThread();
     if (thread->getId() == 0) {
         std::cerr << "thread library error: Cannot call uthread_sleep function on main thread\n";
-        manage_signal(SIG_UNBLOCK);
+        leave_scheduler();
         return -1;
     }
 
     scheduler->sleepCurrentThread(num_quantums);
-    manage_signal(SIG_UNBLOCK);
+    leave_scheduler();
     return 0;
 }
 
 
 /**
- * @brief Returns the thread ID of the calling thread.
+ * @brief Blocks the RUNNING thread for usecs microseconds of wall-clock time (CLOCK_MONOTONIC).
  *
- * @return The ID of the calling thread.
+ * Unlike uthread_sleep, the time passes whether or not the process uses CPU time, and the thread wakes up as soon
+ * as it is over if a kernel thread is idle, and within a quantum otherwise. Any thread, including the main thread,
+ * may sleep. A thread that is blocked while it sleeps stays BLOCKED after the time is over, until it is resumed.
+ * It is an error to pass a negative usecs.
+ *
+ * @return On success, return 0. On failure, return -1.
 */
-int uthread_get_tid() {
-    manage_signal(SIG_BLOCK);
-    int id = scheduler->getCurrentThread()->getId();
-    manage_signal(SIG_UNBLOCK);
-    return id;
+int uthread_sleep_usec(long long usecs) {
+    if (usecs < 0) {
+        std::cerr << "thread library error: Negative time sent to uthread_sleep_usec function\n";
+        return -1;
+    }
+    enter_scheduler();
+    scheduler->sleepCurrentThreadUntil(deadline_after(usecs));
+    leave_scheduler();
+    return 0;
 }
 
 
 /**
- * @brief Returns the total number of quantums since the library was initialized, including the current quantum.
+ * @brief Blocks the RUNNING thread until the CLOCK_MONOTONIC time deadline, like uthread_sleep_usec.
  *
- * Right after the call to uthread_init, the value should be 1.
- * Each time a new quantum starts, regardless of the reason, this number should be increased by 1.
+ * A deadline that already passed only gives up the rest of the quantum.
  *
- * @return The total number of quantums.
+ * @return On success, return 0. On failure, return -1.
 */
-int uthread_get_total_quantums() {
-    manage_signal(SIG_BLOCK);
-    int num = scheduler->getTotalQuantumCycles();
-    manage_signal(SIG_UNBLOCK);
-    return num;
+int uthread_sleep_until(const struct timespec *deadline) {
+    if (!deadline || deadline->tv_sec < 0 || deadline->tv_nsec < 0 || deadline->tv_nsec >= 1000000000) {
+        std::cerr << "thread library error: Invalid deadline sent to uthread_sleep_until function\n";
+        return -1;
+    }
+    // 0 stands for no deadline in the scheduler, and is long past anyway
+    long long nsecs = deadline->tv_sec >= LLONG_MAX / 1000000000LL ? LLONG_MAX :
+                      deadline->tv_sec * 1000000000LL + deadline->tv_nsec;
+    enter_scheduler();
+    scheduler->sleepCurrentThreadUntil(nsecs > 0 ? nsecs : 1);
+    leave_scheduler();
+    return 0;
 }
 
 
 /**
- * @brief Returns the number of quantums the thread with ID tid was in RUNNING state.
+ * @brief Gives up the rest of the RUNNING thread's quantum.
  *
- * On the first time a thread runs, the function should return 1. Every additional quantum that the thread starts should
+ * The calling thread moves to the end of the READY queue and the thread at the head of the queue starts a new
+ * quantum right away, exactly as if the quantum had expired. If no other thread is READY (under MLFQ, at the calling
+ * thread's level or above) the call has no effect: the calling thread keeps running and its quantum is not restarted.
+ * Any thread, including the main thread, may yield.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_yield() {
+    enter_critical();
+    scheduler->yieldCurrentThread();
+    leave_critical();
+    return 0;
+}
+
+
+/**
+ * @brief Counts a tick of the RUNNING thread's quantum, in manual tick mode (see uthread_init_config).
+ *
+ * Once the quantum has lasted its number of ticks, the call acts exactly like the timer going off: the calling thread
+ * drops an MLFQ level, moves to the end of the READY queue, and the thread at the head of the queue starts a new
+ * quantum. Calls are the preemption points of the threads, so they are meant to be placed where a timer could have
+ * interrupted them. It is an error to call this function if the library was not initialized in manual tick mode.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_tick() {
+    enter_critical();
+    if (!scheduler->isManualTick()) {
+        std::cerr << "thread library error: The library is not in manual tick mode, uthread_tick function failed\n";
+        leave_critical();
+        return -1;
+    }
+
+    scheduler->tick();
+    leave_critical();
+    return 0;
+}
+
+
+/**
+ * @brief Disables preemption of the RUNNING thread until the matching uthread_preempt_enable.
+ *
+ * While preemption is disabled the thread keeps running past the end of its quantum; a quantum that expires in the
+ * meantime is acted upon (the thread is moved to the end of the READY queue) as soon as preemption is enabled
+ * again. Calls nest, and neither call makes a system call. The thread may still give up the CPU on its own (e.g.
+ * uthread_yield, uthread_block of itself, uthread_sleep); it runs with preemption disabled again when it resumes.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_preempt_disable() {
+    enter_critical();
+    return 0;
+}
+
+
+/**
+ * @brief Ends the critical section started by the matching uthread_preempt_disable.
+ *
+ * It is an error to call this function without a matching uthread_preempt_disable.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_preempt_enable() {
+    if (Worker::currentThread()->getCriticalDepth() <= 0) {
+        std::cerr << "thread library error: uthread_preempt_enable called without uthread_preempt_disable\n";
+        return -1;
+    }
+
+    leave_critical();
+    return 0;
+}
+
+
+/**
+ * @brief Returns the thread ID of the calling thread.
+ *
+ * @return The ID of the calling thread.
+*/
+int uthread_get_tid() {
+    // only the running thread's own control block is read, which needs no lock, only to stay on this worker
+    enter_critical();
+    int id = Worker::currentThread()->getId();
+    leave_critical();
+    return id;
+}
+
+
+/**
+ * @brief Returns the total number of quantums since the library was initialized, including the current quantum.
+ *
+ * Right after the call to uthread_init, the value should be 1.
+ * Each time a new quantum starts, regardless of the reason, this number should be increased by 1.
+ *
+ * @return The total number of quantums.
+*/
+int uthread_get_total_quantums() {
+    return scheduler->getTotalQuantumCycles();
+}
+
+
+/**
+ * @brief Returns the number of quantums the thread with ID tid was in RUNNING state.
+ *
+ * On the first time a thread runs, the function should return 1. Every additional quantum that the thread starts should
  * increase this value by 1 (so if the thread with ID tid is in RUNNING state when this function is called, include
  * also the current quantum). If no thread with ID tid exists it is considered an error.
  *
  * @return On success, return the number of quantums of the thread with ID tid. On failure, return -1.
 */
 int uthread_get_quantums(int tid) {
-    manage_signal(SIG_BLOCK);
+    enter_scheduler();
     Thread *thread = scheduler->getThreadByID(tid);
     if (!thread || thread->getState() == TERMINATED) {
         std::cerr << "thread library error: Invalid thread ID sent to uthread_get_quantums function\n";
-        manage_signal(SIG_UNBLOCK);
+        leave_scheduler();
         return -1;
     }
     int time = thread->getRunTime();
-    manage_signal(SIG_UNBLOCK);
+    leave_scheduler();
     return time;
 }
+
+/**
+ * @brief Fills stats with the statistics of the thread with ID tid.
+ *
+ * The statistics are only collected if the library was initialized by uthread_init_config with
+ * config->collect_stats set, which costs a few clock readings per context switch. The time the thread spent in its
+ * current state is included. CPU time is counted up to the thread's last switch, and, if the thread is the calling
+ * thread, up to now. If no thread with ID tid exists, or statistics are not collected, it is considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_get_stats(int tid, uthread_stats *stats) {
+    enter_scheduler();
+    if (!scheduler->isCollectingStats()) {
+        std::cerr << "thread library error: Statistics are not collected, uthread_get_stats function failed\n";
+        leave_scheduler();
+        return -1;
+    }
+
+    Thread *thread = scheduler->getThreadByID(tid);
+    if (!thread || thread->getState() == TERMINATED) {
+        std::cerr << "thread library error: Invalid thread ID sent to uthread_get_stats function\n";
+        leave_scheduler();
+        return -1;
+    }
+
+    scheduler->getStats(thread, stats);
+    leave_scheduler();
+    return 0;
+}
+
+/**
+ * @brief Fills stats with the statistics of the whole library.
+ *
+ * The average cost of a context switch is scheduler_nsecs / switches. It is an error to call this function if
+ * statistics are not collected (see uthread_get_stats).
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_get_global_stats(uthread_global_stats *stats) {
+    enter_scheduler();
+    if (!scheduler->isCollectingStats()) {
+        std::cerr << "thread library error: Statistics are not collected, uthread_get_global_stats function failed\n";
+        leave_scheduler();
+        return -1;
+    }
+
+    scheduler->getGlobalStats(stats);
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Writes the scheduler trace to the file at path, as Chrome trace-event JSON.
+ *
+ * The trace is only recorded if the library was initialized by uthread_init_config with config->trace_events set.
+ * Every kernel thread is a track of its own, on which each stretch a thread ran is a slice named after the thread,
+ * and the other events (a thread becoming READY, being blocked, unblocked or terminated, going to sleep, starting to
+ * wait, and the timer going off) are instant events with the thread's ID in their args. Only the last trace_events
+ * events of each kernel thread are kept. Recording an event costs a few stores and a read of the CPU's time stamp
+ * counter, and nothing but a branch when the trace is off. The file can be opened in chrome://tracing or
+ * ui.perfetto.dev. It is an error to call this function before uthread_init, or if the trace is not recorded.
+ *
+ * @return On success, return 0. On failure (including a file that cannot be written, errno is then set), return -1.
+*/
+int uthread_trace_dump(const char *path) {
+    if (scheduler == nullptr) {
+        std::cerr << "thread library error: The library is not initialized, uthread_trace_dump function failed\n";
+        return -1;
+    }
+    if (!scheduler->isTracing()) {
+        std::cerr << "thread library error: The scheduler is not traced, uthread_trace_dump function failed\n";
+        return -1;
+    }
+
+    // allocating and writing inside a critical section, so the thread cannot be preempted in the middle of malloc or
+    // stdio by a thread of the same kernel thread. the rings are copied under their own locks.
+    enter_critical();
+    FILE *out = fopen(path, "w");
+    if (out == nullptr) {
+        leave_critical();
+        return -1;
+    }
+    int workers = scheduler->getWorkerCount();
+    int capacity = scheduler->getTraceCapacity();
+    auto *records = new TraceRing::Record[(long) workers * capacity];
+    auto *counts = new int[workers];
+
+    for (int i = 0; i < workers; ++i)
+        counts[i] = scheduler->copyTrace(i, records + (long) i * capacity);
+
+    bool written = TraceRing::writeChromeJson(out, records, counts, workers, capacity);
+    delete[] records;
+    delete[] counts;
+    if (fclose(out) != 0)
+        written = false;
+    leave_critical();
+    return written ? 0 : -1;
+}
+
+
+/**
+ * @brief Creates a new uthread-local key, and stores it in *key.
+ *
+ * Every thread's value for the new key is NULL. If destructor is not NULL, it is called with the value of each thread
+ * that terminates while its value is not NULL:
+ * - A thread that terminates itself (or returns from its entry point) calls the destructors of its keys before it
+ *   terminates, and its value is NULL during the call. If destructors set values again, it makes up to
+ *   UTHREAD_DESTRUCTOR_ITERATIONS passes over its keys.
+ * - For a thread terminated by another thread, the thread that called uthread_terminate calls the destructors once,
+ *   after the thread was terminated, with the values the thread had at the time of the call. (With M:N scheduling,
+ *   the values of a thread terminated while it runs on another kernel thread are dropped without a call.)
+ * The main thread's values are not destroyed, as terminating it ends the process.
+ * It is an error to create more than UTHREAD_KEYS_MAX keys at once.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *)) {
+    if (!key) {
+        std::cerr << "thread library error: Null key sent to uthread_key_create function\n";
+        return -1;
+    }
+
+    enter_scheduler(); // the lock orders the creates and deletes of different workers
+    for (unsigned index = 0; index < UTHREAD_KEYS_MAX; ++index) {
+        unsigned seq = keys[index].seq.load(std::memory_order_relaxed);
+        if (seq % 2 == 0) {
+            keys[index].destructor = destructor;
+            keys[index].seq.store(seq + 1, std::memory_order_release);
+            *key = index;
+            leave_scheduler();
+            return 0;
+        }
+    }
+    std::cerr << "thread library error: Maximum number of keys reached (" << UTHREAD_KEYS_MAX << ")\n";
+    leave_scheduler();
+    return -1;
+}
+
+
+/**
+ * @brief Deletes the key. Its destructor is not called, and the values of the threads for it are dropped.
+ * It is an error to delete a key that does not exist.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_key_delete(uthread_key_t key) {
+    enter_scheduler();
+    if (key >= UTHREAD_KEYS_MAX || keys[key].seq.load(std::memory_order_relaxed) % 2 == 0) {
+        std::cerr << "thread library error: Invalid key sent to uthread_key_delete function\n";
+        leave_scheduler();
+        return -1;
+    }
+
+    keys[key].seq.fetch_add(1, std::memory_order_release);
+    keys[key].destructor = nullptr;
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Returns the calling thread's value for the key, NULL if it set none or the key does not exist.
+*/
+void *uthread_getspecific(uthread_key_t key) {
+    if (key >= UTHREAD_KEYS_MAX)
+        return nullptr;
+    // the values belong to the calling thread, which finds the same ones wherever it resumes
+    SpecificValue *specific = Worker::currentThread()->getSpecific();
+    if (specific == nullptr || specific[key].seq != keys[key].seq.load(std::memory_order_acquire))
+        return nullptr;
+    return specific[key].value;
+}
+
+
+/**
+ * @brief Sets the calling thread's value for the key. It is an error to set a value for a key that does not exist.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_setspecific(uthread_key_t key, const void *value) {
+    unsigned seq = key < UTHREAD_KEYS_MAX ? keys[key].seq.load(std::memory_order_acquire) : 0;
+    if (seq % 2 == 0) {
+        std::cerr << "thread library error: Invalid key sent to uthread_setspecific function\n";
+        return -1;
+    }
+
+    SpecificValue *specific = Worker::currentThread()->getSpecific();
+    if (specific == nullptr) {
+        // a thread preempted inside the allocator would block the allocations of the threads that run next
+        enter_critical();
+        specific = Worker::currentThread()->createSpecific();
+        leave_critical();
+    }
+    specific[key].seq = seq;
+    specific[key].value = (void *) value;
+    return 0;
+}
+
+
+/**
+ * @brief Initializes the mutex, unlocked.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_init(uthread_mutex_t *mutex) {
+    if (!mutex) {
+        std::cerr << "thread library error: Null mutex sent to uthread_mutex_init function\n";
+        return -1;
+    }
+    *mutex = UTHREAD_MUTEX_INITIALIZER;
+    return 0;
+}
+
+
+/**
+ * @brief Destroys the mutex. It is an error to destroy a mutex that is locked.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_destroy(uthread_mutex_t *mutex) {
+    if (!mutex || atomic_load(&mutex->state) != MUTEX_UNLOCKED) {
+        std::cerr << "thread library error: Null or locked mutex sent to uthread_mutex_destroy function\n";
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Locks the mutex, waiting for it if another thread holds it.
+ *
+ * It is an error to lock a mutex the calling thread already holds.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_lock(uthread_mutex_t *mutex) {
+    return lock_mutex(mutex, 0, "uthread_mutex_lock");
+}
+
+
+/**
+ * @brief Locks the mutex like uthread_mutex_lock, waiting for it for up to usecs microseconds.
+ *
+ * @return On success, return 0. If the time passed first, return 1 without locking the mutex. On failure,
+ * return -1.
+*/
+int uthread_mutex_timedlock(uthread_mutex_t *mutex, long long usecs) {
+    return lock_mutex(mutex, deadline_after(usecs), "uthread_mutex_timedlock");
+}
+
+
+/**
+ * @brief Locks the mutex if no thread holds it.
+ *
+ * @return If the mutex was locked by the call, return 0. Otherwise return -1, which is not considered an error.
+*/
+int uthread_mutex_trylock(uthread_mutex_t *mutex) {
+    if (!mutex || !atomic_cas(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED))
+        return -1;
+    __atomic_store_n(&mutex->owner, Worker::currentThread()->getId(), __ATOMIC_RELAXED);
+    return 0;
+}
+
+
+/**
+ * @brief Unlocks the mutex. If threads wait for it, the first one gets it and becomes READY.
+ *
+ * It is an error to unlock a mutex the calling thread does not hold.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_unlock(uthread_mutex_t *mutex) {
+    if (!mutex || __atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != Worker::currentThread()->getId()) {
+        std::cerr << "thread library error: Mutex not held by the calling thread sent to uthread_mutex_unlock "
+                     "function\n";
+        return -1;
+    }
+
+    __atomic_store_n(&mutex->owner, -1, __ATOMIC_RELAXED);
+    if (atomic_cas(&mutex->state, MUTEX_LOCKED, MUTEX_UNLOCKED))
+        return 0;
+
+    enter_scheduler();
+    release_mutex(mutex);
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Initializes the condition variable, with no waiting threads.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_init(uthread_cond_t *cond) {
+    if (!cond) {
+        std::cerr << "thread library error: Null condition variable sent to uthread_cond_init function\n";
+        return -1;
+    }
+    *cond = UTHREAD_COND_INITIALIZER;
+    return 0;
+}
+
+
+/**
+ * @brief Destroys the condition variable. It is an error to destroy a condition variable threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_destroy(uthread_cond_t *cond) {
+    if (!cond || __atomic_load_n(&cond->waiters.head, __ATOMIC_ACQUIRE) != nullptr) {
+        std::cerr << "thread library error: Null or waited on condition variable sent to uthread_cond_destroy "
+                     "function\n";
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Unlocks the mutex and waits on the condition variable, then locks the mutex again before returning.
+ *
+ * Unlocking the mutex and starting to wait is atomic. If unlocking the mutex woke a thread waiting for it, that
+ * thread runs next. A signaled thread does not compete for the mutex: it is queued for it (or gets it, if it is
+ * unlocked) by the signal itself. It is an error to wait with a mutex the calling thread does not hold, and the main
+ * thread may wait like any other.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex) {
+    return wait_cond(cond, mutex, 0, "uthread_cond_wait");
+}
+
+
+/**
+ * @brief Waits on the condition variable like uthread_cond_wait, for up to usecs microseconds.
+ *
+ * The mutex is locked again when the call returns, whether it was signaled or not.
+ *
+ * @return If the condition variable was signaled, return 0. If the time passed first, return 1. On failure,
+ * return -1.
+*/
+int uthread_cond_timedwait(uthread_cond_t *cond, uthread_mutex_t *mutex, long long usecs) {
+    return wait_cond(cond, mutex, deadline_after(usecs), "uthread_cond_timedwait");
+}
+
+
+/**
+ * @brief Wakes the first thread waiting on the condition variable, if there is one.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_signal(uthread_cond_t *cond) {
+    if (!cond) {
+        std::cerr << "thread library error: Null condition variable sent to uthread_cond_signal function\n";
+        return -1;
+    }
+    if (__atomic_load_n(&cond->waiters.head, __ATOMIC_ACQUIRE) == nullptr)
+        return 0;
+
+    enter_scheduler();
+    Waiter *waiter = WaitQueue(&cond->waiters).popFront();
+    if (waiter != nullptr)
+        signal_waiter(waiter);
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Wakes all the threads waiting on the condition variable. They get the mutex one at a time, in the order
+ * they started waiting.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_broadcast(uthread_cond_t *cond) {
+    if (!cond) {
+        std::cerr << "thread library error: Null condition variable sent to uthread_cond_broadcast function\n";
+        return -1;
+    }
+    if (__atomic_load_n(&cond->waiters.head, __ATOMIC_ACQUIRE) == nullptr)
+        return 0;
+
+    enter_scheduler();
+    WaitQueue waiters(&cond->waiters);
+    while (Waiter *waiter = waiters.popFront())
+        signal_waiter(waiter);
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Initializes the semaphore with the given count. It is an error to pass a negative value.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_init(uthread_sem_t *sem, int value) {
+    if (!sem || value < 0) {
+        std::cerr << "thread library error: Null semaphore or negative value sent to uthread_sem_init function\n";
+        return -1;
+    }
+    sem->value = value;
+    sem->waiters = {nullptr, nullptr};
+    return 0;
+}
+
+
+/**
+ * @brief Destroys the semaphore. It is an error to destroy a semaphore threads wait for.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_destroy(uthread_sem_t *sem) {
+    if (!sem || __atomic_load_n(&sem->waiters.head, __ATOMIC_ACQUIRE) != nullptr) {
+        std::cerr << "thread library error: Null or waited for semaphore sent to uthread_sem_destroy function\n";
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Decrements the semaphore, waiting until it is positive.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_wait(uthread_sem_t *sem) {
+    return wait_sem(sem, 0, "uthread_sem_wait");
+}
+
+
+/**
+ * @brief Decrements the semaphore like uthread_sem_wait, waiting for up to usecs microseconds.
+ *
+ * @return On success, return 0. If the time passed first, return 1 without decrementing it. On failure, return -1.
+*/
+int uthread_sem_timedwait(uthread_sem_t *sem, long long usecs) {
+    return wait_sem(sem, deadline_after(usecs), "uthread_sem_timedwait");
+}
+
+
+/**
+ * @brief Decrements the semaphore if it is positive.
+ *
+ * @return If the semaphore was decremented, return 0. Otherwise return -1, which is not considered an error.
+*/
+int uthread_sem_trywait(uthread_sem_t *sem) {
+    if (!sem)
+        return -1;
+    int value = atomic_load(&sem->value);
+    while (value > 0) {
+        if (__atomic_compare_exchange_n(&sem->value, &value, value - 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return 0;
+    }
+    return -1;
+}
+
+
+/**
+ * @brief Increments the semaphore. If threads wait for it, the first one gets the unit and becomes READY instead.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_post(uthread_sem_t *sem) {
+    if (!sem) {
+        std::cerr << "thread library error: Null semaphore sent to uthread_sem_post function\n";
+        return -1;
+    }
+    if (__atomic_fetch_add(&sem->value, 1, __ATOMIC_ACQ_REL) >= 0)
+        return 0;
+
+    enter_scheduler();
+    wake_sem_waiter(sem);
+    leave_scheduler();
+    return 0;
+}
+
+
+/**
+ * @brief Creates a channel of elements of elem_size bytes (sizeof the element type) with a buffer of capacity
+ * elements, 0 for an unbuffered channel.
+ *
+ * It is an error to pass a zero elem_size or a negative capacity.
+ *
+ * @return On success, return the new channel. On failure, return NULL.
+*/
+uthread_chan_t *uthread_chan_create(size_t elem_size, int capacity) {
+    if (elem_size == 0 || capacity < 0) {
+        std::cerr << "thread library error: Zero element size or negative capacity sent to uthread_chan_create "
+                     "function\n";
+        return nullptr;
+    }
+    // a thread preempted inside the allocator would block the allocations of the threads that run next
+    enter_critical();
+    auto *chan = new uthread_chan(scheduler, elem_size, capacity);
+    leave_critical();
+    return chan;
+}
+
+
+/**
+ * @brief Destroys the channel and releases its memory. It is an error to destroy a channel threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_destroy(uthread_chan_t *chan) {
+    if (!chan) {
+        std::cerr << "thread library error: Null channel sent to uthread_chan_destroy function\n";
+        return -1;
+    }
+    enter_scheduler();
+    bool waited_on = chan->hasWaiters();
+    leave_scheduler();
+    if (waited_on) {
+        std::cerr << "thread library error: Channel threads wait on sent to uthread_chan_destroy function\n";
+        return -1;
+    }
+    enter_critical();
+    delete chan;
+    leave_critical();
+    return 0;
+}
+
+
+/**
+ * @brief Closes the channel: nothing can be sent to it any more, and once the elements in its buffer are received,
+ * receiving from it returns at once. Waiting receivers receive nothing, and waiting senders fail.
+ *
+ * It is an error to close a channel that is already closed.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_close(uthread_chan_t *chan) {
+    if (!chan) {
+        std::cerr << "thread library error: Null channel sent to uthread_chan_close function\n";
+        return -1;
+    }
+    enter_scheduler();
+    bool was_closed = chan->isClosed();
+    chan->close();
+    leave_scheduler();
+    if (was_closed) {
+        std::cerr << "thread library error: Closed channel sent to uthread_chan_close function\n";
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Sends the element elem points to, waiting until a receiver takes it or there is room in the buffer.
+ *
+ * It is an error to send to a closed channel, or to close a channel a thread waits to send to.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_send(uthread_chan_t *chan, const void *elem) {
+    return send_chan(chan, elem, 0, "uthread_chan_send");
+}
+
+
+/**
+ * @brief Sends the element like uthread_chan_send, waiting for up to usecs microseconds.
+ *
+ * @return On success, return 0. If the time passed first, return 1 without sending it. On failure, return -1.
+*/
+int uthread_chan_timedsend(uthread_chan_t *chan, const void *elem, long long usecs) {
+    return send_chan(chan, elem, deadline_after(usecs), "uthread_chan_timedsend");
+}
+
+
+/**
+ * @brief Receives an element into elem, waiting until one is sent.
+ *
+ * @return If an element was received, return 0. If the channel is closed and drained, zero elem and return -1,
+ * which is not considered an error. On failure, return -1.
+*/
+int uthread_chan_recv(uthread_chan_t *chan, void *elem) {
+    return recv_chan(chan, elem, 0, "uthread_chan_recv");
+}
+
+
+/**
+ * @brief Receives an element like uthread_chan_recv, waiting for up to usecs microseconds.
+ *
+ * @return If an element was received, return 0. If the time passed first, return 1. If the channel is closed and
+ * drained, zero elem and return -1, which is not considered an error. On failure, return -1.
+*/
+int uthread_chan_timedrecv(uthread_chan_t *chan, void *elem, long long usecs) {
+    return recv_chan(chan, elem, deadline_after(usecs), "uthread_chan_timedrecv");
+}
+
+
+/**
+ * @brief Carries out one of count channel operations: the first that can go ahead without waiting, starting at a
+ * random case so no case starves, or the first to become possible.
+ *
+ * A receive from a closed and drained channel can always go ahead, and sets the case's ok to 0 (an element received
+ * sets it to 1). A send to a closed channel is an error, as in uthread_chan_send.
+ *
+ * @param block if 0, return -1 at once when no operation can go ahead, which is not considered an error
+ * @return On success, return the index of the case that was carried out. On failure, return -1.
+*/
+int uthread_chan_select(uthread_chan_op *ops, int count, int block) {
+    bool valid = ops && count > 0;
+    for (int i = 0; valid && i < count; ++i)
+        valid = ops[i].chan && ops[i].elem && (ops[i].op == UTHREAD_CHAN_SEND || ops[i].op == UTHREAD_CHAN_RECV);
+    if (!valid) {
+        std::cerr << "thread library error: Invalid operations sent to uthread_chan_select function\n";
+        return -1;
+    }
+
+    // the waiters of a select that has to wait: on the stack if they fit comfortably, thread stacks are small. the
+    // others are allocated inside the critical section, so the thread cannot be preempted in the middle of malloc
+    ChanWaiter local_waiters[SELECT_LOCAL_WAITERS];
+    ChanWaiter *waiters = local_waiters;
+
+    enter_scheduler();
+    if (block && count > SELECT_LOCAL_WAITERS)
+        waiters = new ChanWaiter[count];
+    int selected = -1;
+    Channel::Result result = Channel::WOULD_BLOCK;
+    Thread *woken = nullptr;
+    select_seed = select_seed * 1103515245 + 12345;
+    int start = (int) ((select_seed >> 16) % (unsigned) count);
+    for (int i = 0; i < count && selected < 0; ++i) {
+        int index = (start + i) % count;
+        uthread_chan_op &op = ops[index];
+        if (op.op == UTHREAD_CHAN_SEND)
+            result = op.chan->trySend(op.elem, &woken);
+        else
+            result = op.chan->tryRecv(op.elem);
+        if (result != Channel::WOULD_BLOCK)
+            selected = index;
+    }
+
+    if (selected < 0 && block) {
+        // wait on every channel at once, the first operation carried out ends the wait on the others
+        Thread *self = Worker::currentThread();
+        for (int i = 0; i < count; ++i) {
+            waiters[i].thread = self;
+            waiters[i].object = ops[i].elem;
+            waiters[i].index = i;
+            waiters[i].sibling = &waiters[(i + 1) % count];
+            if (ops[i].op == UTHREAD_CHAN_SEND)
+                ops[i].chan->addSender(&waiters[i]);
+            else
+                ops[i].chan->addReceiver(&waiters[i]);
+        }
+        scheduler->waitCurrentThread(&waiters[0]);
+        for (int i = 0; i < count; ++i) {
+            if (waiters[i].done) {
+                selected = i;
+                result = waiters[i].ok ? Channel::DONE : Channel::CLOSED;
+            }
+        }
+    }
+    else if (woken != nullptr && ops[selected].chan->getCapacity() == 0)
+        scheduler->switchToThread(woken);
+    leave_scheduler();
+
+    if (waiters != local_waiters) {
+        enter_critical();
+        delete[] waiters;
+        leave_critical();
+    }
+    if (selected < 0)
+        return -1;
+    if (ops[selected].op == UTHREAD_CHAN_RECV)
+        ops[selected].ok = result == Channel::DONE;
+    else if (result == Channel::CLOSED) {
+        std::cerr << "thread library error: Closed channel sent to uthread_chan_select function\n";
+        return -1;
+    }
+    return selected;
+}
+
+
+/**
+ * @brief Starts the channel operation async->op without waiting for it: carries it out at once if it can go ahead,
+ * like uthread_chan_select, and queues it on the channel otherwise, where it is carried out in turn, like the
+ * operation of a waiting thread.
+ *
+ * A queued operation ends in the library call that carried it out (or closed the channel), which sets result (and
+ * op.ok for a receive), calls async->complete(async), and posts async->done unless it is NULL. complete is called
+ * from within the library, in whichever thread made that call: it must not call the library, and must return at
+ * once. The library does not touch async after calling it. Until then, async and the element must stay in place,
+ * and the channel cannot be destroyed. A queued operation cannot be cancelled.
+ * It is an error to call this function with an invalid operation (as in uthread_chan_select) or a null complete.
+ *
+ * @return If the operation was carried out at once, return 0 without calling complete. If it was queued, return 1.
+ * On failure, return -1.
+*/
+int uthread_chan_start(uthread_chan_async *async) {
+    if (!async || !async->op.chan || !async->op.elem || !async->complete ||
+        (async->op.op != UTHREAD_CHAN_SEND && async->op.op != UTHREAD_CHAN_RECV)) {
+        std::cerr << "thread library error: Invalid operation sent to uthread_chan_start function\n";
+        return -1;
+    }
+
+    uthread_chan_op &op = async->op;
+    enter_scheduler();
+    Thread *woken; // not switched to: no thread waits for the operation to hand over its quantum
+    Channel::Result result;
+    if (op.op == UTHREAD_CHAN_SEND)
+        result = op.chan->trySend(op.elem, &woken);
+    else
+        result = op.chan->tryRecv(op.elem);
+    if (result == Channel::WOULD_BLOCK) {
+        auto *waiter = new(async->waiter) ChanWaiter(nullptr, op.elem);
+        waiter->complete = complete_async;
+        if (op.op == UTHREAD_CHAN_SEND)
+            op.chan->addSender(waiter);
+        else
+            op.chan->addReceiver(waiter);
+    }
+    leave_scheduler();
+
+    // a queued operation may be completed already, and async gone
+    if (result == Channel::WOULD_BLOCK)
+        return 1;
+    if (op.op == UTHREAD_CHAN_RECV)
+        op.ok = result == Channel::DONE;
+    else if (result == Channel::CLOSED) {
+        std::cerr << "thread library error: Closed channel sent to uthread_chan_start function\n";
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Reads up to count bytes from fd into buf, waiting until some are available.
+ *
+ * @return The number of bytes read, 0 at end of file. On failure, return -1.
+*/
+ssize_t uthread_read(int fd, void *buf, size_t count) {
+    if (set_nonblocking(fd) < 0)
+        return -1;
+    for (;;) {
+        ssize_t result = read(fd, buf, count);
+        if (result >= 0 || !io_would_block())
+            return result;
+        if (wait_for_fd(fd, false) < 0)
+            return -1;
+    }
+}
+
+
+/**
+ * @brief Writes up to count bytes from buf to fd, waiting until some can be written.
+ *
+ * @return The number of bytes written. On failure, return -1.
+*/
+ssize_t uthread_write(int fd, const void *buf, size_t count) {
+    if (set_nonblocking(fd) < 0)
+        return -1;
+    for (;;) {
+        ssize_t result = write(fd, buf, count);
+        if (result >= 0 || !io_would_block())
+            return result;
+        if (wait_for_fd(fd, true) < 0)
+            return -1;
+    }
+}
+
+
+/**
+ * @brief Accepts a connection on the listening socket fd, waiting until one arrives. The new socket is
+ * in blocking mode, like accept's, until it is passed to one of the calls above.
+ *
+ * @return The new socket. On failure, return -1.
+*/
+int uthread_accept(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+    if (set_nonblocking(fd) < 0)
+        return -1;
+    for (;;) {
+        int result = accept(fd, addr, addrlen);
+        if (result >= 0 || !io_would_block())
+            return result;
+        if (wait_for_fd(fd, false) < 0)
+            return -1;
+    }
+}
+
+
+/**
+ * @brief Connects the socket fd to addr, waiting until the connection is established.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_connect(int fd, const struct sockaddr *addr, socklen_t addrlen) {
+    if (set_nonblocking(fd) < 0)
+        return -1;
+    if (connect(fd, addr, addrlen) == 0)
+        return 0;
+    if (io_errno() != EINPROGRESS)
+        return -1;
+
+    // the connection goes on in the background, the socket becomes writable once it is established or failed
+    if (wait_for_fd(fd, true) < 0)
+        return -1;
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+        return -1;
+    if (error != 0) {
+        set_io_errno(error);
+        return -1;
+    }
+    return 0;
+}
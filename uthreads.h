@@ -7,11 +7,134 @@
 #ifndef _UTHREADS_H
 #define _UTHREADS_H
 
-#define MAX_THREAD_NUM 100 /* maximal number of threads */
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define MAX_THREAD_NUM 100 /* default maximal number of threads */
 #define STACK_SIZE 4096 /* stack size per thread (in bytes) */
 
+#define UTHREAD_POLICY_RR 0 /* round robin over a single ready queue */
+#define UTHREAD_POLICY_MLFQ 1 /* multi-level feedback queue, see uthread_init_config */
+#define MLFQ_LEVELS 4 /* default number of MLFQ priority levels */
+#define MLFQ_MAX_LEVELS 16 /* maximal number of MLFQ priority levels */
+#define MLFQ_BOOST_QUANTUMS 100 /* default number of quantums between two MLFQ priority boosts */
+#define UTHREAD_KEYS_MAX 64 /* maximal number of uthread-local keys */
+#define UTHREAD_DESTRUCTOR_ITERATIONS 4 /* passes over the key destructors of a thread that terminates itself */
+
 typedef void (*thread_entry_point)(void);
 
+/*
+ * Library settings for uthread_init_config. Fields left 0 get their default value.
+ */
+typedef struct uthread_config {
+    int quantum_usecs; /* the length of a quantum in micro-seconds, must be positive */
+    int max_threads; /* maximal number of concurrent threads, main thread included. default MAX_THREAD_NUM */
+    int workers; /* number of kernel threads running the threads (M:N scheduling if more than 1). default 1 */
+    int policy; /* UTHREAD_POLICY_RR or UTHREAD_POLICY_MLFQ. default UTHREAD_POLICY_RR */
+    int mlfq_levels; /* number of MLFQ priority levels, at most MLFQ_MAX_LEVELS. default MLFQ_LEVELS */
+    int mlfq_boost_quantums; /* quantums between two MLFQ priority boosts. default MLFQ_BOOST_QUANTUMS */
+    int collect_stats; /* non-zero to collect the statistics of uthread_get_stats. default 0 */
+    int tickless; /* non-zero to stop the timer while there is nothing to preempt for. default 0 */
+    int trace_events; /* scheduler events each kernel thread keeps for uthread_trace_dump, 0 for none. default 0 */
+    int manual_ticks; /* non-zero to end quantums by calls to uthread_tick instead of a timer. default 0 */
+    int quantum_ticks; /* with manual_ticks, the calls to uthread_tick a quantum lasts. default 1 */
+    int no_guard_pages; /* non-zero for red zones rather than PROT_NONE guard pages below the stacks. default 0 */
+} uthread_config;
+
+/*
+ * The statistics of a single thread, see uthread_get_stats. Times are in nanoseconds.
+ */
+typedef struct uthread_stats {
+    long long cpu_nsecs; /* CPU time the thread consumed */
+    long long ready_nsecs; /* time spent READY, waiting for its turn to run */
+    long long blocked_nsecs; /* time spent BLOCKED, or waiting for a mutex, condition variable or semaphore */
+    long long sleeping_nsecs; /* time spent sleeping */
+    long long voluntary_switches; /* times the thread gave up running: blocked, slept or yielded */
+    long long involuntary_switches; /* times the thread was preempted at the end of a quantum */
+} uthread_stats;
+
+/*
+ * The statistics of the whole library, see uthread_get_global_stats.
+ */
+typedef struct uthread_global_stats {
+    long long switches; /* context switches from one thread to another (idle workers not included) */
+    long long involuntary_switches; /* of them, preemptions at the end of a quantum */
+    long long scheduler_nsecs; /* CPU time spent choosing the next thread and switching to it */
+    int threads; /* number of existing threads, main thread included */
+} uthread_global_stats;
+
+/*
+ * The threads waiting for a synchronization object. Internal, only initialized by the object's initializer.
+ */
+typedef struct uthread_wait_queue {
+    void *head;
+    void *tail;
+} uthread_wait_queue;
+
+/*
+ * A uthread-local key, see uthread_key_create.
+ */
+typedef unsigned int uthread_key_t;
+
+/*
+ * A mutex, see uthread_mutex_lock. Initialize it with uthread_mutex_init or UTHREAD_MUTEX_INITIALIZER.
+ */
+typedef struct uthread_mutex {
+    int state; /* 0 unlocked, 1 locked, 2 locked and there may be threads waiting */
+    int owner; /* the ID of the thread holding the mutex, -1 if none */
+    uthread_wait_queue waiters;
+} uthread_mutex_t;
+
+#define UTHREAD_MUTEX_INITIALIZER {0, -1, {0, 0}}
+
+/*
+ * A condition variable, see uthread_cond_wait. Initialize it with uthread_cond_init or UTHREAD_COND_INITIALIZER.
+ */
+typedef struct uthread_cond {
+    uthread_wait_queue waiters;
+} uthread_cond_t;
+
+#define UTHREAD_COND_INITIALIZER {{0, 0}}
+
+/*
+ * A counting semaphore, see uthread_sem_wait. Initialize it with uthread_sem_init.
+ */
+typedef struct uthread_sem {
+    int value; /* the count, or minus the number of waiting threads */
+    uthread_wait_queue waiters;
+} uthread_sem_t;
+
+/*
+ * A channel, see uthread_chan_create.
+ */
+typedef struct uthread_chan uthread_chan_t;
+
+#define UTHREAD_CHAN_SEND 0
+#define UTHREAD_CHAN_RECV 1
+
+/*
+ * A case of uthread_chan_select.
+ */
+typedef struct uthread_chan_op {
+    uthread_chan_t *chan;
+    int op; /* UTHREAD_CHAN_SEND or UTHREAD_CHAN_RECV */
+    void *elem; /* the element to send, or where to receive it */
+    int ok; /* set for a selected receive: 1 if an element was received, 0 if the channel was closed and drained */
+} uthread_chan_op;
+
+/*
+ * A channel operation no thread waits for, see uthread_chan_start.
+ */
+typedef struct uthread_chan_async {
+    uthread_chan_op op; /* the operation, whose ok is set like a selected case's */
+    void (*complete)(struct uthread_chan_async *async); /* called once a queued operation is carried out */
+    uthread_sem_t *done; /* posted right after complete is called, unless NULL */
+    int result; /* set before complete is called: 0, or -1 if the channel was closed before a send went ahead */
+    void *waiter[12]; /* Internal, the operation's place in the channel's queue */
+} uthread_chan_async;
+
 /* External interface */
 
 
@@ -29,21 +152,106 @@ typedef void (*thread_entry_point)(void);
 */
 int uthread_init(int quantum_usecs);
 
+/**
+ * @brief initializes the thread library with the given settings.
+ *
+ * Behaves exactly like uthread_init(config->quantum_usecs), except that the limit on the number of concurrent
+ * threads is config->max_threads instead of MAX_THREAD_NUM. Call either this function or uthread_init, once.
+ * It is an error to pass a non-positive quantum_usecs (unless manual_ticks is set) or a negative max_threads or
+ * workers.
+ *
+ * With config->workers > 1 the threads are scheduled M:N: the calling kernel thread and workers - 1 new kernel
+ * threads each run threads from a ready queue of their own, preempt them with a timer on their own CPU time, and
+ * take threads from the longest ready queue when their own runs dry. A thread may move between kernel threads
+ * whenever it is switched out. The API keeps its meaning with these differences:
+ * - Blocking or terminating a thread that is RUNNING on another kernel thread takes effect as soon as that kernel
+ *   thread can be interrupted, shortly after the call returns.
+ * - Quantums are counted over all kernel threads together.
+ * - uthread_terminate(0) exits without releasing the library's memory.
+ * - errno is kept per thread, but a thread must not keep the address of errno across a call that may switch.
+ *
+ * With config->policy == UTHREAD_POLICY_MLFQ the READY threads are kept at mlfq_levels priority levels instead of
+ * in a single line, and the next thread to run is the first in line at the highest level that has any:
+ * - Every thread starts at the highest level, 0.
+ * - A thread that is preempted at the end of its quantum drops one level (down to the lowest).
+ * - A thread that blocks, sleeps, yields or is blocked before its quantum ends keeps its level.
+ * - The quantum of a thread at level n is quantum_usecs * 2^n.
+ * - Every mlfq_boost_quantums quantums all threads go back to level 0, so that threads at low levels do not
+ *   starve.
+ * A thread that yields only hands over to READY threads at its own level or above.
+ * It is an error to pass an unknown policy, negative MLFQ settings or more than MLFQ_MAX_LEVELS levels.
+ *
+ * With config->tickless set, a kernel thread only keeps its timer running while there is something to preempt
+ * for: READY threads, threads sleeping with uthread_sleep, or threads waiting for fds. Otherwise the timer is
+ * off, or set to go off once at the next deadline of uthread_sleep_usec or of a timed wait, and a thread that
+ * runs alone is not interrupted and counts no new quantums. While it runs, the timer ticks every quantum_usecs
+ * and is not set again on every switch, so a quantum of a thread lasts between 1 and 2 times its length.
+ *
+ * With config->trace_events > 0 every kernel thread records what the scheduler does on it in a ring of its last
+ * trace_events events (rounded up to a power of 2), see uthread_trace_dump. It is an error to pass a negative
+ * trace_events.
+ *
+ * With config->manual_ticks set, no timer is armed and quantums only end by calls to uthread_tick: a quantum lasts
+ * quantum_ticks calls (quantum_ticks * 2^n at MLFQ level n), and quantum_usecs is not used. Threads are then only
+ * switched at ticks and at the library calls that give up the CPU, so a program that does not depend on the clock
+ * (uthread_sleep_usec, timed waits, fds) runs the exact same schedule every time. It is an error to set manual_ticks
+ * together with tickless or more than one worker, or to pass a negative quantum_ticks.
+ *
+ * Every thread stack sits above a PROT_NONE guard page, so a thread that overflows its stack faults right away. Each
+ * thread then takes two of the process's memory mappings, which limits the number of threads to about half of
+ * vm.max_map_count (65530 by default). With config->no_guard_pages set, the pages below the stacks are left
+ * unprotected, so there is no such limit: an overflow of less than a page is only caught when the thread is deleted
+ * (and the process exits), and a larger one may overwrite the stack below it.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_config(const uthread_config *config);
+
 /**
  * @brief Creates a new thread, whose entry point is the function entry_point with the signature
  * void entry_point(void).
  *
  * The thread is added to the end of the READY threads list.
  * The uthread_spawn function should fail if it would cause the number of concurrent threads to exceed the
- * limit (MAX_THREAD_NUM).
+ * limit (MAX_THREAD_NUM, or the max_threads given to uthread_init_config).
  * Each thread should be allocated with a stack of size STACK_SIZE bytes.
- * It is an error to call this function with a null entry_point.
+ * It is an error to call this function with a null entry_point. It fails as well if no memory could be mapped for
+ * the stack.
  *
  * @return On success, return the ID of the created thread. On failure, return -1.
 */
 int uthread_spawn(thread_entry_point entry_point);
 
 
+/**
+ * @brief Creates a new thread that runs start_routine(arg), and can be joined with uthread_join.
+ *
+ * The thread is created like by uthread_spawn, and when start_routine returns the thread terminates. Until some
+ * thread joins it (or it is detached with uthread_detach), a terminated thread remains a zombie: it keeps its ID,
+ * counts towards the thread limit, and keeps what start_routine returned (NULL if it was terminated by
+ * uthread_terminate). Library calls on a zombie other than uthread_join and uthread_detach fail as if no
+ * thread with its ID existed.
+ * It is an error to call this function with a null start_routine.
+ *
+ * @return On success, return the ID of the created thread. On failure, return -1.
+*/
+int uthread_spawn_arg(void *(*start_routine)(void *), void *arg);
+
+
+/**
+ * @brief Creates count threads, all with the entry point entry_point, and stores their IDs in tids (unless it is
+ * NULL).
+ *
+ * Behaves like count calls to uthread_spawn, made in a single visit to the scheduler, which sets up the room for the
+ * threads and their stacks at once. The threads are added to the end of the READY threads list in order. Either all
+ * of them are created or none is: it is an error if they would exceed the thread limit, and to call this function
+ * with a null entry_point or a non-positive count. It fails as well if no memory could be mapped for the stacks.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_spawn_n(thread_entry_point entry_point, int count, int *tids);
+
+
 /**
  * @brief Terminates the thread with ID tid and deletes it from all relevant control structures.
  *
@@ -57,6 +265,33 @@ int uthread_spawn(thread_entry_point entry_point);
 int uthread_terminate(int tid);
 
 
+/**
+ * @brief Waits for the thread with ID tid to terminate, and releases it.
+ *
+ * The calling thread waits (without using quantums) until the thread terminates, unless it already did. If result
+ * is not NULL, what the thread's start routine returned is stored in *result (NULL for a thread created by
+ * uthread_spawn, or terminated by uthread_terminate). Any thread may be joined, while it exists, but only a thread
+ * created by uthread_spawn_arg can be joined after it terminated.
+ * If no thread with ID tid exists it is considered an error. It is also an error to join the main thread
+ * (tid == 0), the calling thread itself, or a thread that another thread is already joining.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_join(int tid, void **result);
+
+
+/**
+ * @brief Makes the thread with ID tid release its resources as soon as it terminates, without being joined.
+ *
+ * Detaching a zombie (see uthread_spawn_arg) releases it right away. Detaching a thread created by uthread_spawn
+ * has no effect. If no thread with ID tid exists it is considered an error, and so is detaching a thread that
+ * another thread is joining.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_detach(int tid);
+
+
 /**
  * @brief Blocks the thread with ID tid. The thread may be resumed later using uthread_resume.
  *
@@ -69,6 +304,18 @@ int uthread_terminate(int tid);
 int uthread_block(int tid);
 
 
+/**
+ * @brief Blocks the threads whose IDs are the count first elements of tids, like uthread_block does each one.
+ *
+ * The threads are blocked in a single visit to the scheduler. If the calling thread is one of them it is blocked
+ * last, after the others. Either all of the threads are blocked or none is: it is an error if one of the IDs is the
+ * main thread's (0) or is not the ID of an existing thread, and to pass a null tids or a negative count.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_block_many(const int *tids, int count);
+
+
 /**
  * @brief Resumes a blocked thread with ID tid and moves it to the READY state.
  *
@@ -80,6 +327,36 @@ int uthread_block(int tid);
 int uthread_resume(int tid);
 
 
+/**
+ * @brief Resumes the threads whose IDs are the count first elements of tids, like uthread_resume does each one.
+ *
+ * The threads are resumed in a single visit to the scheduler, and added to the end of the READY threads list in
+ * order. Either all of the threads are resumed or none is: it is an error if one of the IDs is not the ID of an
+ * existing thread, and to pass a null tids or a negative count.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_resume_many(const int *tids, int count);
+
+
+/**
+ * @brief Resumes the thread with ID tid like uthread_resume does, from any kernel thread.
+ *
+ * Unlike the rest of the library, it may be called from kernel threads that do not run threads (helper pthreads
+ * that completed work on behalf of a thread) and from signal handlers: it takes no lock and is async-signal-safe.
+ * The resume is posted to an inbox, and carried out at the next scheduling decision, which an idle kernel thread of
+ * the library is woken to make. As with uthread_resume, the resume has no effect if the thread is not BLOCKED by
+ * then. Posting a resume for a thread whose posted resume is still pending has no further effect. The resume is
+ * meant for the thread that has the ID when it is posted: it is dropped if that thread terminated by the time the
+ * resume is carried out, even if a new thread was given the ID since.
+ * It is an error to pass an ID that cannot be a thread's (negative, or not below the maximal number of threads),
+ * and to call it before uthread_init. Nothing is printed on errors, printing is not async-signal-safe.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_post_resume(int tid);
+
+
 /**
  * @brief Blocks the RUNNING thread for num_quantums quantums.
  *
@@ -95,6 +372,75 @@ int uthread_resume(int tid);
 */
 int uthread_sleep(int num_quantums);
 
+/**
+ * @brief Blocks the RUNNING thread for usecs microseconds of wall-clock time (CLOCK_MONOTONIC).
+ *
+ * Unlike uthread_sleep, the time passes whether or not the process uses CPU time, and the thread wakes up as soon
+ * as it is over if a kernel thread is idle, and within a quantum otherwise. Any thread, including the main thread,
+ * may sleep. A thread that is blocked while it sleeps stays BLOCKED after the time is over, until it is resumed.
+ * It is an error to pass a negative usecs.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sleep_usec(long long usecs);
+
+/**
+ * @brief Blocks the RUNNING thread until the CLOCK_MONOTONIC time deadline, like uthread_sleep_usec.
+ *
+ * A deadline that already passed only gives up the rest of the quantum.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sleep_until(const struct timespec *deadline);
+
+
+/**
+ * @brief Gives up the rest of the RUNNING thread's quantum.
+ *
+ * The calling thread moves to the end of the READY queue and the thread at the head of the queue starts a new
+ * quantum right away, exactly as if the quantum had expired. If no other thread is READY (under MLFQ, at the calling
+ * thread's level or above) the call has no effect: the calling thread keeps running and its quantum is not restarted.
+ * Any thread, including the main thread, may yield.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_yield();
+
+/**
+ * @brief Counts a tick of the RUNNING thread's quantum, in manual tick mode (see uthread_init_config).
+ *
+ * Once the quantum has lasted its number of ticks, the call acts exactly like the timer going off: the calling thread
+ * drops an MLFQ level, moves to the end of the READY queue, and the thread at the head of the queue starts a new
+ * quantum. Calls are the preemption points of the threads, so they are meant to be placed where a timer could have
+ * interrupted them. It is an error to call this function if the library was not initialized in manual tick mode.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_tick();
+
+
+/**
+ * @brief Disables preemption of the RUNNING thread until the matching uthread_preempt_enable.
+ *
+ * While preemption is disabled the thread keeps running past the end of its quantum; a quantum that expires in the
+ * meantime is acted upon (the thread is moved to the end of the READY queue) as soon as preemption is enabled
+ * again. Calls nest, and neither call makes a system call. The thread may still give up the CPU on its own (e.g.
+ * uthread_yield, uthread_block of itself, uthread_sleep); it runs with preemption disabled again when it resumes.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_preempt_disable();
+
+
+/**
+ * @brief Ends the critical section started by the matching uthread_preempt_disable.
+ *
+ * It is an error to call this function without a matching uthread_preempt_disable.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_preempt_enable();
+
 
 /**
  * @brief Returns the thread ID of the calling thread.
@@ -127,4 +473,388 @@ int uthread_get_total_quantums();
 int uthread_get_quantums(int tid);
 
 
+/**
+ * @brief Fills stats with the statistics of the thread with ID tid.
+ *
+ * The statistics are only collected if the library was initialized by uthread_init_config with
+ * config->collect_stats set, which costs a few clock readings per context switch. The time the thread spent in its
+ * current state is included. CPU time is counted up to the thread's last switch, and, if the thread is the calling
+ * thread, up to now. If no thread with ID tid exists, or statistics are not collected, it is considered an error.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_get_stats(int tid, uthread_stats *stats);
+
+
+/**
+ * @brief Fills stats with the statistics of the whole library.
+ *
+ * The average cost of a context switch is scheduler_nsecs / switches. It is an error to call this function if
+ * statistics are not collected (see uthread_get_stats).
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_get_global_stats(uthread_global_stats *stats);
+
+/**
+ * @brief Writes the scheduler trace to the file at path, as Chrome trace-event JSON.
+ *
+ * The trace is only recorded if the library was initialized by uthread_init_config with config->trace_events set.
+ * Every kernel thread is a track of its own, on which each stretch a thread ran is a slice named after the thread,
+ * and the other events (a thread becoming READY, being blocked, unblocked or terminated, going to sleep, starting to
+ * wait, and the timer going off) are instant events with the thread's ID in their args. Only the last trace_events
+ * events of each kernel thread are kept. Recording an event costs a few stores and a read of the CPU's time stamp
+ * counter, and nothing but a branch when the trace is off. The file can be opened in chrome://tracing or
+ * ui.perfetto.dev. It is an error to call this function before uthread_init, or if the trace is not recorded.
+ *
+ * @return On success, return 0. On failure (including a file that cannot be written, errno is then set), return -1.
+*/
+int uthread_trace_dump(const char *path);
+
+
+/*
+ * Uthread-local storage
+ *
+ * Every thread has a value of its own for each key, NULL until it sets one. Getting and setting the calling thread's
+ * value takes constant time and never enters the scheduler: the thread is found through a kernel-thread-local
+ * pointer that every switch updates.
+ */
+
+/**
+ * @brief Creates a new uthread-local key, and stores it in *key.
+ *
+ * Every thread's value for the new key is NULL. If destructor is not NULL, it is called with the value of each thread
+ * that terminates while its value is not NULL:
+ * - A thread that terminates itself (or returns from its entry point) calls the destructors of its keys before it
+ *   terminates, and its value is NULL during the call. If destructors set values again, it makes up to
+ *   UTHREAD_DESTRUCTOR_ITERATIONS passes over its keys.
+ * - For a thread terminated by another thread, the thread that called uthread_terminate calls the destructors once,
+ *   after the thread was terminated, with the values the thread had at the time of the call. (With M:N scheduling,
+ *   the values of a thread terminated while it runs on another kernel thread are dropped without a call.)
+ * The main thread's values are not destroyed, as terminating it ends the process.
+ * It is an error to create more than UTHREAD_KEYS_MAX keys at once.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *));
+
+/**
+ * @brief Deletes the key. Its destructor is not called, and the values of the threads for it are dropped.
+ * It is an error to delete a key that does not exist.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_key_delete(uthread_key_t key);
+
+/**
+ * @brief Returns the calling thread's value for the key, NULL if it set none or the key does not exist.
+*/
+void *uthread_getspecific(uthread_key_t key);
+
+/**
+ * @brief Sets the calling thread's value for the key. It is an error to set a value for a key that does not exist.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_setspecific(uthread_key_t key, const void *value);
+
+
+/*
+ * Synchronization
+ *
+ * A thread waiting for a mutex, a condition variable or a semaphore is neither READY nor BLOCKED, and
+ * uthread_resume does not wake it. uthread_block still applies to it: it stays BLOCKED after it got what it waited
+ * for, until it is resumed. A thread that is terminated while waiting leaves the wait, and a mutex it holds stays
+ * locked. Waiting threads are served in FIFO order, and a thread that is woken is handed what it waited for (the
+ * mutex, or the semaphore's unit) directly, so no other thread can take it in between.
+ * Locking an unlocked mutex, unlocking a mutex nobody waits for, signaling a condition variable nobody waits on,
+ * and waiting for or posting a semaphore without waiting threads never enter the scheduler.
+ * The timed variants measure their timeout in wall-clock time, like uthread_sleep_usec.
+ */
+
+/**
+ * @brief Initializes the mutex, unlocked.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_init(uthread_mutex_t *mutex);
+
+/**
+ * @brief Destroys the mutex. It is an error to destroy a mutex that is locked.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_destroy(uthread_mutex_t *mutex);
+
+/**
+ * @brief Locks the mutex, waiting for it if another thread holds it.
+ *
+ * It is an error to lock a mutex the calling thread already holds.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_lock(uthread_mutex_t *mutex);
+
+/**
+ * @brief Locks the mutex like uthread_mutex_lock, waiting for it for up to usecs microseconds.
+ *
+ * @return On success, return 0. If the time passed first, return 1 without locking the mutex. On failure,
+ * return -1.
+*/
+int uthread_mutex_timedlock(uthread_mutex_t *mutex, long long usecs);
+
+/**
+ * @brief Locks the mutex if no thread holds it.
+ *
+ * @return If the mutex was locked by the call, return 0. Otherwise return -1, which is not considered an error.
+*/
+int uthread_mutex_trylock(uthread_mutex_t *mutex);
+
+/**
+ * @brief Unlocks the mutex. If threads wait for it, the first one gets it and becomes READY.
+ *
+ * It is an error to unlock a mutex the calling thread does not hold.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_mutex_unlock(uthread_mutex_t *mutex);
+
+/**
+ * @brief Initializes the condition variable, with no waiting threads.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_init(uthread_cond_t *cond);
+
+/**
+ * @brief Destroys the condition variable. It is an error to destroy a condition variable threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_destroy(uthread_cond_t *cond);
+
+/**
+ * @brief Unlocks the mutex and waits on the condition variable, then locks the mutex again before returning.
+ *
+ * Unlocking the mutex and starting to wait is atomic. If unlocking the mutex woke a thread waiting for it, that
+ * thread runs next. A signaled thread does not compete for the mutex: it is queued for it (or gets it, if it is
+ * unlocked) by the signal itself. It is an error to wait with a mutex the calling thread does not hold, and the main
+ * thread may wait like any other.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_wait(uthread_cond_t *cond, uthread_mutex_t *mutex);
+
+/**
+ * @brief Waits on the condition variable like uthread_cond_wait, for up to usecs microseconds.
+ *
+ * The mutex is locked again when the call returns, whether it was signaled or not.
+ *
+ * @return If the condition variable was signaled, return 0. If the time passed first, return 1. On failure,
+ * return -1.
+*/
+int uthread_cond_timedwait(uthread_cond_t *cond, uthread_mutex_t *mutex, long long usecs);
+
+/**
+ * @brief Wakes the first thread waiting on the condition variable, if there is one.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_signal(uthread_cond_t *cond);
+
+/**
+ * @brief Wakes all the threads waiting on the condition variable. They get the mutex one at a time, in the order
+ * they started waiting.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_cond_broadcast(uthread_cond_t *cond);
+
+/**
+ * @brief Initializes the semaphore with the given count. It is an error to pass a negative value.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_init(uthread_sem_t *sem, int value);
+
+/**
+ * @brief Destroys the semaphore. It is an error to destroy a semaphore threads wait for.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_destroy(uthread_sem_t *sem);
+
+/**
+ * @brief Decrements the semaphore, waiting until it is positive.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_wait(uthread_sem_t *sem);
+
+/**
+ * @brief Decrements the semaphore like uthread_sem_wait, waiting for up to usecs microseconds.
+ *
+ * @return On success, return 0. If the time passed first, return 1 without decrementing it. On failure, return -1.
+*/
+int uthread_sem_timedwait(uthread_sem_t *sem, long long usecs);
+
+/**
+ * @brief Decrements the semaphore if it is positive.
+ *
+ * @return If the semaphore was decremented, return 0. Otherwise return -1, which is not considered an error.
+*/
+int uthread_sem_trywait(uthread_sem_t *sem);
+
+/**
+ * @brief Increments the semaphore. If threads wait for it, the first one gets the unit and becomes READY instead.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_sem_post(uthread_sem_t *sem);
+
+
+/*
+ * Channels
+ *
+ * A channel carries elements of a fixed size from sending threads to receiving threads, in FIFO order. An
+ * unbuffered channel (capacity 0) hands each element from a sender to a receiver directly, so a send waits for a
+ * receiver and a receive waits for a sender. A buffered channel also holds up to capacity elements, so a send only
+ * waits while the buffer is full and a receive only while it is empty.
+ * An element is copied once: from the sender's element straight into the receiver's, unless it has to wait in the
+ * buffer. A thread waiting on a channel is WAITING, like a thread waiting for a mutex (see Synchronization), and a
+ * sender that hands an element to a waiting receiver of an unbuffered channel switches to the receiver right away,
+ * resuming right after it.
+ */
+
+/**
+ * @brief Creates a channel of elements of elem_size bytes (sizeof the element type) with a buffer of capacity
+ * elements, 0 for an unbuffered channel.
+ *
+ * It is an error to pass a zero elem_size or a negative capacity.
+ *
+ * @return On success, return the new channel. On failure, return NULL.
+*/
+uthread_chan_t *uthread_chan_create(size_t elem_size, int capacity);
+
+/**
+ * @brief Destroys the channel and releases its memory. It is an error to destroy a channel threads wait on.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_destroy(uthread_chan_t *chan);
+
+/**
+ * @brief Closes the channel: nothing can be sent to it any more, and once the elements in its buffer are received,
+ * receiving from it returns at once. Waiting receivers receive nothing, and waiting senders fail.
+ *
+ * It is an error to close a channel that is already closed.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_close(uthread_chan_t *chan);
+
+/**
+ * @brief Sends the element elem points to, waiting until a receiver takes it or there is room in the buffer.
+ *
+ * It is an error to send to a closed channel, or to close a channel a thread waits to send to.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_chan_send(uthread_chan_t *chan, const void *elem);
+
+/**
+ * @brief Sends the element like uthread_chan_send, waiting for up to usecs microseconds.
+ *
+ * @return On success, return 0. If the time passed first, return 1 without sending it. On failure, return -1.
+*/
+int uthread_chan_timedsend(uthread_chan_t *chan, const void *elem, long long usecs);
+
+/**
+ * @brief Receives an element into elem, waiting until one is sent.
+ *
+ * @return If an element was received, return 0. If the channel is closed and drained, zero elem and return -1,
+ * which is not considered an error. On failure, return -1.
+*/
+int uthread_chan_recv(uthread_chan_t *chan, void *elem);
+
+/**
+ * @brief Receives an element like uthread_chan_recv, waiting for up to usecs microseconds.
+ *
+ * @return If an element was received, return 0. If the time passed first, return 1. If the channel is closed and
+ * drained, zero elem and return -1, which is not considered an error. On failure, return -1.
+*/
+int uthread_chan_timedrecv(uthread_chan_t *chan, void *elem, long long usecs);
+
+/**
+ * @brief Carries out one of count channel operations: the first that can go ahead without waiting, starting at a
+ * random case so no case starves, or the first to become possible.
+ *
+ * A receive from a closed and drained channel can always go ahead, and sets the case's ok to 0 (an element received
+ * sets it to 1). A send to a closed channel is an error, as in uthread_chan_send.
+ *
+ * @param block if 0, return -1 at once when no operation can go ahead, which is not considered an error
+ * @return On success, return the index of the case that was carried out. On failure, return -1.
+*/
+int uthread_chan_select(uthread_chan_op *ops, int count, int block);
+
+/**
+ * @brief Starts the channel operation async->op without waiting for it: carries it out at once if it can go ahead,
+ * like uthread_chan_select, and queues it on the channel otherwise, where it is carried out in turn, like the
+ * operation of a waiting thread.
+ *
+ * A queued operation ends in the library call that carried it out (or closed the channel), which sets result (and
+ * op.ok for a receive), calls async->complete(async), and posts async->done unless it is NULL. complete is called
+ * from within the library, in whichever thread made that call: it must not call the library, and must return at
+ * once. The library does not touch async after calling it. Until then, async and the element must stay in place,
+ * and the channel cannot be destroyed. A queued operation cannot be cancelled.
+ * It is an error to call this function with an invalid operation (as in uthread_chan_select) or a null complete.
+ *
+ * @return If the operation was carried out at once, return 0 without calling complete. If it was queued, return 1.
+ * On failure, return -1.
+*/
+int uthread_chan_start(uthread_chan_async *async);
+
+
+/*
+ * I/O
+ *
+ * The calls below behave like the system calls they are named after, except that they only suspend the calling
+ * thread: the fd is put in non-blocking mode (and left in it), and when the call would block the thread waits
+ * for the fd to become ready, WAITING like a thread waiting for a mutex (see Synchronization), while other
+ * threads run. Ready fds are looked for every few switches, once a quantum, and whenever no thread is ready, in
+ * which case an idle kernel thread waits for them.
+ * They are meant for sockets and pipes. It is an error to close an fd a thread waits for.
+ * On failure they return -1 and set errno, like the system calls, and print no error message.
+ */
+
+/**
+ * @brief Reads up to count bytes from fd into buf, waiting until some are available.
+ *
+ * @return The number of bytes read, 0 at end of file. On failure, return -1.
+*/
+ssize_t uthread_read(int fd, void *buf, size_t count);
+
+/**
+ * @brief Writes up to count bytes from buf to fd, waiting until some can be written.
+ *
+ * @return The number of bytes written. On failure, return -1.
+*/
+ssize_t uthread_write(int fd, const void *buf, size_t count);
+
+/**
+ * @brief Accepts a connection on the listening socket fd, waiting until one arrives. The new socket is
+ * in blocking mode, like accept's, until it is passed to one of the calls above.
+ *
+ * @return The new socket. On failure, return -1.
+*/
+int uthread_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief Connects the socket fd to addr, waiting until the connection is established.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_connect(int fd, const struct sockaddr *addr, socklen_t addrlen);
+
+
 #endif